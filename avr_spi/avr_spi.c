@@ -2,13 +2,42 @@
  *
  *	spi.c
  *
- *  Polled SPI driver for AVR
+ *  Polled SPI driver for AVR (SPI module, USART, USI or bit-bang)
  *
  ************************************************/
 
 #include <avr/io.h> 
+#include <avr/interrupt.h>
 #include "avr_spi.h"
 
+#if (SPI_BACKEND == SPI_BACKEND_USI) || (SPI_BACKEND == SPI_BACKEND_SOFT)
+#include <util/delay_basic.h>
+#endif
+
+static spi_device_t			*_spi_current;	/* Device for which bus is programmed (0 after SPI_Init) */
+static volatile uint8_t		_spi_owned;		/* Bus is owned by a device (SPI_Acquire) */
+static spi_deferred_t		*_spi_deferred;		/* Functions waiting for the bus, in order of SPI_Defer() */
+static spi_deferred_t		*_spi_deferred_last;
+
+#if SPI_ASYNC_ENABLED
+/* State of the asynchronous transfer */
+static const uint8_t		*_spi_tx;
+static uint8_t				*_spi_rx;
+static volatile uint16_t	_spi_count;		/* Bytes remaining, including the one being shifted */
+static spi_callback_t		_spi_callback;
+static spi_device_t			*_spi_dev;		/* Device selected for the transfer */
+static volatile uint8_t		_spi_busy;
+#endif
+
+#if (SPI_BACKEND == SPI_BACKEND_USI) || (SPI_BACKEND == SPI_BACKEND_SOFT)
+/* Half clock period delay (_delay_loop_1 count, 3 cycles each) for each SPI_CLKDIV_t. The rate is
+ * approximate: loop overhead is not counted, and 0 is the fastest the backend can go.
+ */
+static const uint8_t _spi_soft_delay[] = { 0, 2, 10, 20, 0, 1, 4 };
+#endif
+
+#if (SPI_BACKEND == SPI_BACKEND_HW) || (SPI_BACKEND == SPI_BACKEND_HOST)
+
 /* Initialize the SPI interface in Master mode with given SPI mode and clock rate division */
 void SPI_Init(SPI_MODE_t mode, SPI_CLKDIV_t clk_div)
 {
@@ -30,10 +59,27 @@ void SPI_Init(SPI_MODE_t mode, SPI_CLKDIV_t clk_div)
 	{
 		SPSR = 0x1;  /* SPI2X bit */
 	}
-	
+	_spi_current = 0;
 }
 
 
+/* SPCR and SPSR values of a device */
+static void spi_device_regs(spi_device_t *dev, SPI_MODE_t mode, SPI_CLKDIV_t clk_div)
+{
+	dev->ctrl = (1 << SPE)|(1 << MSTR)|(mode << 2)|(clk_div & 0x3);
+	dev->rate = (clk_div >> 2) & 0x1;  /* SPI2X */
+}
+
+
+static void spi_device_apply(spi_device_t *dev)
+{
+	SPCR = dev->ctrl;
+	SPSR = dev->rate;
+}
+
+
+#if SPI_BACKEND == SPI_BACKEND_HW
+
 uint8_t SPI_TxRx(uint8_t data)
 {
 	/* Start transmission */
@@ -47,19 +93,710 @@ uint8_t SPI_TxRx(uint8_t data)
 }
 
 
-void SPI_TxBuf(const uint8_t *buf, uint16_t length)
+#if defined(__AVR__)
+/* Transfer at SPI_CLKDIV_2 (16 cycles per byte), without polling SPIF
+ *	SPDR of the previous byte is read 17 cycles after it was started and the next byte is written just after,
+ *	so an interrupt in the loop only adds to the gap. NULL buffers are replaced by a single byte with
+ *	pointer increment 0. SPIF stays set during the loop, it is cleared at the end.
+ */
+static void spi_transfer_div2(const uint8_t *tx, uint8_t *rx, uint16_t length)
 {
+	static const uint8_t zero = 0x00;
+	static uint8_t discard;
+	uint8_t tx_inc = 1, rx_inc = 1;
+	uint8_t data, tmp;
+	
+	if(!tx)
+	{
+		tx = &zero;
+		tx_inc = 0;
+	}
+	if(!rx)
+	{
+		rx = &discard;
+		rx_inc = 0;
+	}
+	
+	__asm__ __volatile__ (
+		"ld		%[tmp], X				\n\t"	/* First byte */
+		"add	r26, %[txi]				\n\t"
+		"adc	r27, __zero_reg__		\n\t"
+		"out	%[spdr], %[tmp]			\n\t"	/* cycle 0 */
+		"sbiw	%[cnt], 1				\n\t"
+		"breq	2f						\n\t"
+		"rjmp	.+0						\n\t"	/* 5 cycles to align with the loop */
+		"rjmp	.+0						\n\t"
+		"nop							\n\t"
+	"1:									\n\t"
+		"ld		%[tmp], X				\n\t"	/* Next byte */
+		"add	r26, %[txi]				\n\t"
+		"adc	r27, __zero_reg__		\n\t"
+		"rjmp	.+0						\n\t"
+		"rjmp	.+0						\n\t"
+		"in		%[data], %[spdr]		\n\t"	/* cycle 17: previous byte complete */
+		"out	%[spdr], %[tmp]			\n\t"	/* cycle 18 = 0 */
+		"st		Z, %[data]				\n\t"
+		"add	r30, %[rxi]				\n\t"
+		"adc	r31, __zero_reg__		\n\t"
+		"sbiw	%[cnt], 1				\n\t"
+		"brne	1b						\n\t"
+		"rjmp	3f						\n\t"	/* (loop exit reaches 3 at cycle 10) */
+	"2:									\n\t"
+		"rjmp	.+0						\n\t"	/* Single byte (2 reached at cycle 5) */
+		"rjmp	.+0						\n\t"
+		"nop							\n\t"
+	"3:									\n\t"
+		"rjmp	.+0						\n\t"
+		"rjmp	.+0						\n\t"
+		"rjmp	.+0						\n\t"
+		"nop							\n\t"
+		"in		%[tmp], %[spsr]			\n\t"	/* cycle 17: last byte complete, SPIF set */
+		"in		%[data], %[spdr]		\n\t"	/* SPSR then SPDR read clears SPIF */
+		"st		Z, %[data]				\n\t"
+		: [tmp] "=&r" (tmp), [data] "=&r" (data), [cnt] "+w" (length), "+x" (tx), "+z" (rx)
+		: [txi] "r" (tx_inc), [rxi] "r" (rx_inc),
+		  [spdr] "I" (_SFR_IO_ADDR(SPDR)), [spsr] "I" (_SFR_IO_ADDR(SPSR))
+		: "memory"
+	);
+}
+#endif
+
+
+void SPI_TransferBuf(const uint8_t *tx, uint8_t *rx, uint16_t length)
+{
+	uint8_t next, data;
+	
+	if(!length)
+	{
+		return;
+	}
+#if defined(__AVR__)
+	if(!(SPCR & 0x3) && (SPSR & (1 << SPI2X)))
+	{
+		spi_transfer_div2(tx, rx, length);
+		return;
+	}
+#endif
+	SPDR = tx ? *tx++ : 0x00;
+	while(--length)
+	{
+		/* Fetch next byte while the current one is shifted */
+		next = tx ? *tx++ : 0x00;
+		while(!(SPSR & (1 << SPIF)))
+			;
+		data = SPDR;
+		SPDR = next;
+		if(rx)
+		{
+			*rx++ = data;
+		}
+	}
+	while(!(SPSR & (1 << SPIF)))
+		;
+	data = SPDR;
+	if(rx)
+	{
+		*rx = data;
+	}
+}
+
+#else
+
+/* Host build (host_sim): registers are programmed as for the SPI module, bytes go to the device models of
+ * spi_sim.c, which also sees the CS changes of SPI_Acquire()/SPI_Release()
+ */
+#include "spi_sim.h"
+
+#define SPI_CS_CHANGED()	spi_sim_cs_update()
+
+uint8_t SPI_TxRx(uint8_t data)
+{
+	return spi_sim_xfer(data);
+}
+
+
+void SPI_TransferBuf(const uint8_t *tx, uint8_t *rx, uint16_t length)
+{
+	uint8_t data;
+	
 	while(length--)
 	{
-		SPI_TxRx(*buf++);
+		data = spi_sim_xfer(tx ? *tx++ : 0x00);
+		if(rx)
+		{
+			*rx++ = data;
+		}
 	}
 }
 
-void SPI_RxBuf(uint8_t *buf, uint16_t length)
+#endif
+
+
+#elif SPI_BACKEND == SPI_BACKEND_USART
+
+/* USART0 in Master SPI mode (MSPIM). MOSI is TXD, MISO is RXD and SCK is XCK */
+#if !defined(UMSEL01)
+	#error "USART of this MCU has no Master SPI mode"
+#endif
+
+#if !defined(SPI_USART_XCK_BIT)
+#if defined(__AVR_ATmega48__) || defined(__AVR_ATmega48A__) || defined(__AVR_ATmega48P__) || defined(__AVR_ATmega48PA__) \
+	|| defined(__AVR_ATmega88__) || defined(__AVR_ATmega88A__) || defined(__AVR_ATmega88P__) || defined(__AVR_ATmega88PA__) \
+	|| defined(__AVR_ATmega168__) || defined(__AVR_ATmega168A__) || defined(__AVR_ATmega168P__) || defined(__AVR_ATmega168PA__) \
+	|| defined(__AVR_ATmega328__) || defined(__AVR_ATmega328P__)
+	#define SPI_USART_XCK_DDR		DDRD
+	#define SPI_USART_XCK_BIT		PD4
+	#define SPI_USART_TXD_DDR		DDRD
+	#define SPI_USART_TXD_BIT		PD1
+#elif defined(__AVR_ATmega164A__) || defined(__AVR_ATmega164P__) || defined(__AVR_ATmega164PA__) || defined(__AVR_ATmega324A__) \
+	|| defined(__AVR_ATmega324P__) || defined(__AVR_ATmega324PA__) || defined(__AVR_ATmega644__) || defined(__AVR_ATmega644A__) \
+	|| defined(__AVR_ATmega644P__) || defined(__AVR_ATmega644PA__) || defined(__AVR_ATmega1284__) || defined(__AVR_ATmega1284P__)
+	#define SPI_USART_XCK_DDR		DDRB
+	#define SPI_USART_XCK_BIT		PB0
+	#define SPI_USART_TXD_DDR		DDRD
+	#define SPI_USART_TXD_BIT		PD1
+#else
+	#error "XCK/TXD pins not known for this MCU. Please define SPI_USART_XCK_DDR, SPI_USART_XCK_BIT, SPI_USART_TXD_DDR and SPI_USART_TXD_BIT"
+#endif
+#endif
+
+/* UBRR0 for each SPI_CLKDIV_t : SCK = F_CPU / (2 * (UBRR0 + 1)) */
+static const uint8_t _spi_ubrr[] = { 1, 7, 31, 63, 0, 3, 15 };
+
+
+/* Initialize USART0 as SPI Master with given SPI mode and clock rate division */
+void SPI_Init(SPI_MODE_t mode, SPI_CLKDIV_t clk_div)
+{
+	/* XCK pin as output selects master mode */
+	SPI_USART_XCK_DDR |= (1 << SPI_USART_XCK_BIT);
+	SPI_USART_TXD_DDR |= (1 << SPI_USART_TXD_BIT);
+	
+#ifdef ALT_SS_DDR
+	ALT_SS_DDR |= (1 << ALT_SS_BIT);
+#else
+	SPI_DDR |= (1 << SS_BIT);
+#endif
+	SS_HIGH();
+	
+	/* Baud rate should be 0 when transmitter is enabled */
+	UBRR0 = 0;
+	UCSR0C = (1 << UMSEL01)|(1 << UMSEL00)|((mode & 1) << UCPHA0)|((mode >> 1) << UCPOL0);  /* MSPIM, MSB first, given mode */
+	UCSR0B = (1 << RXEN0)|(1 << TXEN0);
+	UBRR0 = _spi_ubrr[clk_div];
+	_spi_current = 0;
+}
+
+
+/* UCSR0C and UBRR0 values of a device */
+static void spi_device_regs(spi_device_t *dev, SPI_MODE_t mode, SPI_CLKDIV_t clk_div)
+{
+	dev->ctrl = (1 << UMSEL01)|(1 << UMSEL00)|((mode & 1) << UCPHA0)|((mode >> 1) << UCPOL0);
+	dev->rate = _spi_ubrr[clk_div];
+}
+
+
+static void spi_device_apply(spi_device_t *dev)
+{
+	/* Transfer functions return after the last byte is received, so the USART is idle here */
+	UCSR0C = dev->ctrl;
+	UBRR0 = dev->rate;
+}
+
+
+uint8_t SPI_TxRx(uint8_t data)
+{
+	while(!(UCSR0A & (1 << UDRE0)))
+		;
+	UDR0 = data;
+	
+	while(!(UCSR0A & (1 << RXC0)))
+		;
+	
+	return UDR0;
+}
+
+
+/* Transmit buffer keeps the next byte ready, so bytes are sent back-to-back */
+void SPI_TransferBuf(const uint8_t *tx, uint8_t *rx, uint16_t length)
+{
+	uint16_t tx_count = length;
+	uint8_t data;
+	
+	while(length)
+	{
+		if(tx_count && (UCSR0A & (1 << UDRE0)))
+		{
+			UDR0 = tx ? *tx++ : 0x00;
+			tx_count--;
+		}
+		if(UCSR0A & (1 << RXC0))
+		{
+			data = UDR0;
+			if(rx)
+			{
+				*rx++ = data;
+			}
+			length--;
+		}
+	}
+}
+
+#elif SPI_BACKEND == SPI_BACKEND_USI
+
+/* USI in three-wire mode (ATtiny). DO is MOSI, DI is MISO and USCK is SCK.
+ *	The shift register is clocked by USCK edges and USCK is toggled by software (USITC strobe). The sampling
+ *	edge (USICS0) and the idle level of USCK give the SPI mode.
+ */
+#if !defined(USICR)
+	#error "This MCU has no USI"
+#endif
+
+#if !defined(SPI_USI_DO_BIT)
+#if defined(__AVR_ATtiny25__) || defined(__AVR_ATtiny45__) || defined(__AVR_ATtiny85__) \
+	|| defined(__AVR_ATtiny261__) || defined(__AVR_ATtiny461__) || defined(__AVR_ATtiny861__) \
+	|| defined(__AVR_ATtiny261A__) || defined(__AVR_ATtiny461A__) || defined(__AVR_ATtiny861A__)
+	#define SPI_USI_PORT			PORTB
+	#define SPI_USI_DDR				DDRB
+	#define SPI_USI_DO_BIT			PB1
+	#define SPI_USI_USCK_BIT		PB2
+#elif defined(__AVR_ATtiny24__) || defined(__AVR_ATtiny44__) || defined(__AVR_ATtiny84__) \
+	|| defined(__AVR_ATtiny24A__) || defined(__AVR_ATtiny44A__) || defined(__AVR_ATtiny84A__)
+	#define SPI_USI_PORT			PORTA
+	#define SPI_USI_DDR				DDRA
+	#define SPI_USI_DO_BIT			PA5
+	#define SPI_USI_USCK_BIT		PA4
+#elif defined(__AVR_ATtiny2313__) || defined(__AVR_ATtiny2313A__) || defined(__AVR_ATtiny4313__)
+	#define SPI_USI_PORT			PORTB
+	#define SPI_USI_DDR				DDRB
+	#define SPI_USI_DO_BIT			PB6
+	#define SPI_USI_USCK_BIT		PB7
+#else
+	#error "USI pins not known for this MCU. Please define SPI_USI_PORT, SPI_USI_DDR, SPI_USI_DO_BIT and SPI_USI_USCK_BIT"
+#endif
+#endif
+
+/* Current USICR value for a clock toggle, and half clock period delay (0: unrolled, maximum SCK) */
+static uint8_t	_spi_usicr;
+static uint8_t	_spi_delay;
+
+
+/* USICR value and clock delay of a device */
+static void spi_device_regs(spi_device_t *dev, SPI_MODE_t mode, SPI_CLKDIV_t clk_div)
+{
+	/* Modes 0 and 3 sample on rising edge, modes 1 and 2 on falling edge */
+	dev->ctrl = (1 << USIWM0)|(1 << USICS1)|(((mode ^ (mode >> 1)) & 1) << USICS0)|(1 << USICLK)|(1 << USITC);
+	dev->ctrl |= (mode & 2) << 6;		/* CPOL, kept in bit 7 (USISIE, not written to USICR) */
+	dev->rate = _spi_soft_delay[clk_div];
+}
+
+
+static void spi_device_apply(spi_device_t *dev)
+{
+	/* USCK idle level */
+	if(dev->ctrl & 0x80)
+	{
+		SPI_USI_PORT |= (1 << SPI_USI_USCK_BIT);
+	}
+	else
+	{
+		SPI_USI_PORT &= ~(1 << SPI_USI_USCK_BIT);
+	}
+	_spi_usicr = dev->ctrl & 0x7F;
+	_spi_delay = dev->rate;
+}
+
+
+/* Initialize the USI as SPI Master with given SPI mode and clock rate division */
+void SPI_Init(SPI_MODE_t mode, SPI_CLKDIV_t clk_div)
+{
+	spi_device_t dev;
+	
+	/* DO and USCK as output, DI is input */
+	SPI_USI_DDR |= (1 << SPI_USI_DO_BIT)|(1 << SPI_USI_USCK_BIT);
+	
+#ifdef ALT_SS_DDR
+	ALT_SS_DDR |= (1 << ALT_SS_BIT);
+#else
+	SPI_DDR |= (1 << SS_BIT);
+#endif
+	SS_HIGH();
+	
+	spi_device_regs(&dev, mode, clk_div);
+	spi_device_apply(&dev);
+	USICR = (1 << USIWM0);
+	_spi_current = 0;
+}
+
+
+uint8_t SPI_TxRx(uint8_t data)
+{
+	uint8_t usicr = _spi_usicr;
+	uint8_t i;
+	
+	USIDR = data;
+	if(!_spi_delay)
+	{
+		/* 16 clock toggles, one cycle each: SCK = F_CPU / 2 */
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+		USICR = usicr;
+	}
+	else
+	{
+		for(i = 0; i < 16; i++)
+		{
+			USICR = usicr;
+			_delay_loop_1(_spi_delay);
+		}
+	}
+	return USIDR;
+}
+
+
+void SPI_TransferBuf(const uint8_t *tx, uint8_t *rx, uint16_t length)
 {
+	uint8_t data;
+	
 	while(length--)
 	{
-		*buf++ = SPI_TxRx(0x00);
-	}	
+		data = SPI_TxRx(tx ? *tx++ : 0x00);
+		if(rx)
+		{
+			*rx++ = data;
+		}
+	}
+}
+
+
+#elif SPI_BACKEND == SPI_BACKEND_SOFT
+
+/* GPIO bit-bang: MOSI_BIT, MISO_BIT and SCK_BIT of SPI_PORT/SPI_DDR/SPI_PIN */
+#if !defined(SPI_PIN) || !defined(MISO_BIT)
+	#error "SPI_BACKEND_SOFT needs SPI_PIN and MISO_BIT in spi_config.h"
+#endif
+
+#define SCK_HIGH()		(SPI_PORT |= (1 << SCK_BIT))
+#define SCK_LOW()		(SPI_PORT &= ~(1 << SCK_BIT))
+
+/* Clock edges, from idle level (CPOL) and back */
+#define SCK_LEADING()	do { if(_spi_mode & 2) SCK_LOW(); else SCK_HIGH(); } while(0)
+#define SCK_TRAILING()	do { if(_spi_mode & 2) SCK_HIGH(); else SCK_LOW(); } while(0)
+
+/* Current SPI mode and half clock period delay (0: no delay, maximum SCK) */
+static uint8_t	_spi_mode;
+static uint8_t	_spi_delay;
+
+
+/* Mode and clock delay of a device */
+static void spi_device_regs(spi_device_t *dev, SPI_MODE_t mode, SPI_CLKDIV_t clk_div)
+{
+	dev->ctrl = mode;
+	dev->rate = _spi_soft_delay[clk_div];
 }
 
+
+static void spi_device_apply(spi_device_t *dev)
+{
+	/* SCK idle level is CPOL */
+	if(dev->ctrl & 2)
+	{
+		SCK_HIGH();
+	}
+	else
+	{
+		SCK_LOW();
+	}
+	_spi_mode = dev->ctrl;
+	_spi_delay = dev->rate;
+}
+
+
+/* Initialize the SPI pins for bit-bang Master with given SPI mode and clock rate division */
+void SPI_Init(SPI_MODE_t mode, SPI_CLKDIV_t clk_div)
+{
+	spi_device_t dev;
+	
+	/* Set MOSI, SCK, SS as ouput, MISO as input */
+	SPI_DDR |= (1 << MOSI_BIT)|(1 << SCK_BIT)|(1 << SS_BIT);
+	SPI_DDR &= ~(1 << MISO_BIT);
+	
+#ifdef ALT_SS_DDR
+	ALT_SS_DDR |= (1 << ALT_SS_BIT);
+#endif
+	SS_HIGH();
+	
+	spi_device_regs(&dev, mode, clk_div);
+	spi_device_apply(&dev);
+	_spi_current = 0;
+}
+
+
+uint8_t SPI_TxRx(uint8_t data)
+{
+	uint8_t i;
+	
+	for(i = 0; i < 8; i++)
+	{
+		if(_spi_mode & 1)
+		{
+			/* CPHA = 1: data changes on leading edge, sampled on trailing edge */
+			SCK_LEADING();
+		}
+		if(data & 0x80)
+		{
+			SPI_PORT |= (1 << MOSI_BIT);
+		}
+		else
+		{
+			SPI_PORT &= ~(1 << MOSI_BIT);
+		}
+		if(_spi_delay)
+		{
+			_delay_loop_1(_spi_delay);
+		}
+		if(_spi_mode & 1)
+		{
+			SCK_TRAILING();
+		}
+		else
+		{
+			SCK_LEADING();
+		}
+		data <<= 1;
+		if(SPI_PIN & (1 << MISO_BIT))
+		{
+			data |= 1;
+		}
+		if(_spi_delay)
+		{
+			_delay_loop_1(_spi_delay);
+		}
+		if(!(_spi_mode & 1))
+		{
+			/* CPHA = 0: back to idle level after the sampling edge */
+			SCK_TRAILING();
+		}
+	}
+	return data;
+}
+
+
+void SPI_TransferBuf(const uint8_t *tx, uint8_t *rx, uint16_t length)
+{
+	uint8_t data;
+	
+	while(length--)
+	{
+		data = SPI_TxRx(tx ? *tx++ : 0x00);
+		if(rx)
+		{
+			*rx++ = data;
+		}
+	}
+}
+
+#endif
+
+/* Backend notified of CS changes (host simulation) */
+#ifndef SPI_CS_CHANGED
+#define SPI_CS_CHANGED()
+#endif
+
+
+void SPI_TxBuf(const uint8_t *buf, uint16_t length)
+{
+	SPI_TransferBuf(buf, 0, length);
+}
+
+void SPI_RxBuf(uint8_t *buf, uint16_t length)
+{
+	SPI_TransferBuf(0, buf, length);
+}
+
+
+void SPI_Device_Init(spi_device_t *dev, SPI_MODE_t mode, SPI_CLKDIV_t clk_div,
+					 volatile uint8_t *cs_port, volatile uint8_t *cs_ddr, uint8_t cs_bit)
+{
+	dev->cs_port = cs_port;
+	dev->cs_mask = (1 << cs_bit);
+	spi_device_regs(dev, mode, clk_div);
+	if(dev == _spi_current)
+	{
+		/* Set again: programmed by the next SPI_Acquire() */
+		_spi_current = 0;
+	}
+	
+	*cs_port |= dev->cs_mask;
+	*cs_ddr |= dev->cs_mask;
+}
+
+
+/* Programs mode and clock rate of the device, if not already set, and sets its CS LOW */
+static void spi_select(spi_device_t *dev)
+{
+	if(dev != _spi_current)
+	{
+		spi_device_apply(dev);
+		_spi_current = dev;
+	}
+	*dev->cs_port &= ~dev->cs_mask;
+	SPI_CS_CHANGED();
+}
+
+
+void SPI_Acquire(spi_device_t *dev)
+{
+	_spi_owned = 1;
+	spi_select(dev);
+}
+
+
+uint8_t SPI_Bus_Busy(void)
+{
+#if SPI_ASYNC_ENABLED
+	return _spi_owned || _spi_busy;
+#else
+	return _spi_owned;
+#endif
+}
+
+
+/* Runs the deferred functions, if the bus is free */
+static void spi_run_deferred(void)
+{
+	spi_deferred_t *entry;
+	uint8_t sreg;
+	
+	for(;;)
+	{
+		sreg = SREG;
+		cli();
+		entry = _spi_deferred;
+		if(SPI_Bus_Busy() || !entry)
+		{
+			SREG = sreg;
+			return;
+		}
+		_spi_deferred = entry->next;
+		entry->queued = 0;
+		SREG = sreg;
+		entry->func();
+	}
+}
+
+
+void SPI_Release(spi_device_t *dev)
+{
+	*dev->cs_port |= dev->cs_mask;
+	SPI_CS_CHANGED();
+	_spi_owned = 0;
+	spi_run_deferred();
+}
+
+
+void SPI_Defer(spi_deferred_t *entry)
+{
+	if(entry->queued)
+	{
+		return;
+	}
+	entry->queued = 1;
+	entry->next = 0;
+	if(_spi_deferred)
+	{
+		_spi_deferred_last->next = entry;
+	}
+	else
+	{
+		_spi_deferred = entry;
+	}
+	_spi_deferred_last = entry;
+}
+
+
+#if SPI_ASYNC_ENABLED
+
+uint8_t SPI_Transfer_Async(spi_device_t *dev, const uint8_t *tx, uint8_t *rx, uint16_t length, spi_callback_t callback)
+{
+	uint8_t sreg = SREG;
+	
+	cli();
+	if(_spi_busy || _spi_owned)
+	{
+		SREG = sreg;
+		return 1;
+	}
+	if(!length)
+	{
+		SREG = sreg;
+		if(callback)
+		{
+			callback();
+		}
+		return 0;
+	}
+	_spi_busy = 1;
+	_spi_tx = tx;
+	_spi_rx = rx;
+	_spi_count = length;
+	_spi_callback = callback;
+	_spi_dev = dev;
+	
+	spi_select(dev);
+	/* Clear SPIF of a previous polled byte, so that the interrupt is for this byte */
+	(void)SPSR;
+	(void)SPDR;
+	SPCR |= (1 << SPIE);
+	SPDR = tx ? *_spi_tx++ : 0x00;
+	SREG = sreg;
+	return 0;
+}
+
+
+uint8_t SPI_Busy(void)
+{
+	return _spi_busy;
+}
+
+
+/* Byte complete: store received byte and send next one, or end the transfer */
+ISR(SPI_STC_vect)
+{
+	uint8_t data = SPDR;
+	spi_callback_t callback;
+	
+	if(_spi_rx)
+	{
+		*_spi_rx++ = data;
+	}
+	if(--_spi_count)
+	{
+		SPDR = _spi_tx ? *_spi_tx++ : 0x00;
+		return;
+	}
+	SPCR &= ~(1 << SPIE);
+	*_spi_dev->cs_port |= _spi_dev->cs_mask;
+	SPI_CS_CHANGED();
+	callback = _spi_callback;
+	_spi_busy = 0;
+	if(callback)
+	{
+		callback();
+	}
+	spi_run_deferred();
+}
+
+#endif
@@ -2,14 +2,53 @@
  *
  * 	spi.h
  *
- *  Polled SPI driver for AVR
+ *  Polled SPI driver for AVR (SPI module, USART, USI or bit-bang, or simulated on host)
+ *  (optional interrupt driven transfers with SPI_ASYNC_ENABLED)
  *
  ************************************************/
- 
+
+#ifndef AVR_SPI_H
+#define AVR_SPI_H
+
 #include <stdint.h>
 #include "spi_config.h" 
 
 
+/* Peripheral used for SPI, selected by defining SPI_BACKEND in spi_config.h
+ *	SPI_BACKEND_HW		- SPI module (default). Pins: SPI_DDR, MOSI_BIT, SCK_BIT, SS_BIT
+ *	SPI_BACKEND_USART	- USART0 in Master SPI mode (ATmega48/88/168/328, 164/324/644/1284). MOSI = TXD,
+ *						  MISO = RXD, SCK = XCK. The transmit buffer allows back-to-back bytes in SPI_TransferBuf().
+ *						  SS pin is still SS_BIT of SPI_PORT/SPI_DDR, or ALT_SS_PORT/ALT_SS_DDR/ALT_SS_BIT.
+ *	SPI_BACKEND_USI		- USI in three-wire mode (ATtiny25/45/85, 24/44/84, 261/461/861, 2313/4313). MOSI = DO,
+ *						  MISO = DI, SCK = USCK (SPI_USI_PORT/SPI_USI_DDR/SPI_USI_DO_BIT/SPI_USI_USCK_BIT to override).
+ *						  SCK is toggled by unrolled USICR writes: F_CPU/2 at SPI_CLKDIV_2 and SPI_CLKDIV_4, slower
+ *						  rates are approximate. SS pin as for SPI_BACKEND_USART.
+ *	SPI_BACKEND_SOFT	- GPIO bit-bang on any port. Pins: SPI_PORT, SPI_DDR, SPI_PIN, MOSI_BIT, MISO_BIT, SCK_BIT,
+ *						  SS_BIT. Fastest rate is about F_CPU/20, slower rates are approximate.
+ *	SPI_BACKEND_HOST	- Host (Linux) build of host_sim: bytes are exchanged with the device models of spi_sim.c
+ */
+#define SPI_BACKEND_HW			0
+#define SPI_BACKEND_USART		1
+#define SPI_BACKEND_USI			2
+#define SPI_BACKEND_SOFT		3
+#define SPI_BACKEND_HOST		4
+
+#ifndef SPI_BACKEND
+#define SPI_BACKEND				SPI_BACKEND_HW
+#endif
+
+/* Define SPI_ASYNC_ENABLED to 1 in spi_config.h for SPI_Transfer_Async(). This defines ISR(SPI_STC_vect).
+ * Each byte costs an interrupt (about 50 cycles), so it only frees the CPU at SPI_CLKDIV_16 and slower.
+ */
+#ifndef SPI_ASYNC_ENABLED
+#define SPI_ASYNC_ENABLED		0
+#endif
+
+#if SPI_ASYNC_ENABLED && (SPI_BACKEND != SPI_BACKEND_HW)
+	#error "SPI_ASYNC_ENABLED needs SPI_BACKEND_HW"
+#endif
+
+
 typedef enum spi_mode
 {
 	SPI_MODE0,
@@ -31,6 +70,29 @@ typedef enum spi_clk_div
 } SPI_CLKDIV_t;
 
 
+/* Function called by the driver: completion of asynchronous transfer, or deferred bus access (SPI_Defer) */
+typedef void (*spi_callback_t)(void);
+
+/* A function waiting for the bus (SPI_Defer). Each interrupt handler deferring work has its own, in static storage */
+typedef struct spi_deferred
+{
+	spi_callback_t			func;
+	/* Used by the driver */
+	uint8_t					queued;
+	struct spi_deferred		*next;
+} spi_deferred_t;
+
+
+/* A device on the SPI bus, with its own mode, clock rate and chip select pin (see SPI_Device_Init) */
+typedef struct spi_device
+{
+	volatile uint8_t	*cs_port;	/* PORT register of CS pin */
+	uint8_t				cs_mask;	/* Bit mask of CS pin */
+	uint8_t				ctrl;		/* Control register value for mode and clock (SPCR, UCSR0C for USART, USICR for USI) */
+	uint8_t				rate;		/* Clock rate register value (SPSR, UBRR0 for USART, delay for USI/bit-bang) */
+} spi_device_t;
+
+
 
 #ifndef ALT_SS_PORT
 	#define SS_HIGH()		(SPI_PORT |= (1 << SS_BIT))
@@ -47,3 +109,74 @@ void SPI_Init(SPI_MODE_t mode, SPI_CLKDIV_t clk_div);
 uint8_t SPI_TxRx(uint8_t data);
 void SPI_TxBuf(const uint8_t *buf, uint16_t length);
 void SPI_RxBuf(uint8_t *buf, uint16_t length);
+
+/* Full-duplex transfer of 'length' bytes: tx[i] is sent while rx[i] is received (SS is not changed)
+ *	tx - Bytes to send (NULL to send 0x00)
+ *	rx - Buffer for received bytes (NULL to discard)
+ *	The next byte is written to SPDR as soon as the previous one is complete. At SPI_CLKDIV_2 a
+ *	cycle-counted loop is used instead of polling SPIF: 18 CPU cycles per byte (16 for the byte itself).
+ */
+void SPI_TransferBuf(const uint8_t *tx, uint8_t *rx, uint16_t length);
+
+
+/* Initializes a device descriptor and its CS pin (output, HIGH)
+ *	SPI_Init() should be called once before, to set up the bus pins. The mode and clock rate of the
+ *	device are programmed by SPI_Acquire(), only when the bus was last used by another device.
+ *	eg: SPI_Device_Init(&sd_card, SPI_MODE0, SPI_CLKDIV_64, &PORTB, &DDRB, PB0);
+ */
+void SPI_Device_Init(spi_device_t *dev, SPI_MODE_t mode, SPI_CLKDIV_t clk_div,
+					 volatile uint8_t *cs_port, volatile uint8_t *cs_ddr, uint8_t cs_bit);
+
+
+/* Takes the bus for the device: sets its mode and clock rate, if not already set, and its CS LOW
+ *	The bus stays owned until SPI_Release(). From an interrupt handler, check SPI_Bus_Busy() first.
+ */
+void SPI_Acquire(spi_device_t *dev);
+
+
+/* Sets CS of the device HIGH and frees the bus. Mode and clock rate are kept for the next SPI_Acquire()
+ *	Functions deferred by interrupt handlers (SPI_Defer) are run here, before returning.
+ */
+void SPI_Release(spi_device_t *dev);
+
+
+/* Returns 1 if the bus is owned (between SPI_Acquire and SPI_Release, or asynchronous transfer in progress)
+ *	An interrupt handler which finds the bus busy must not use it, as it would corrupt the transaction
+ *	it interrupted. It can hand over its work with SPI_Defer().
+ */
+uint8_t SPI_Bus_Busy(void);
+
+
+/* Queues entry->func to be called when the bus is released. To be called with interrupts disabled (eg: from
+ * interrupt handler). An entry already queued is not queued again, so deferring can't fail.
+ *	func runs in the context of the code releasing the bus: SPI_Release() of the main program, possibly with
+ *	interrupts disabled, or of another interrupt handler, or the end of an asynchronous transfer. It should only
+ *	unmask the interrupt source, which was masked when deferring (a level-triggered source stays active), so
+ *	that its handler runs again, with the bus free, as soon as interrupts are enabled.
+ */
+void SPI_Defer(spi_deferred_t *entry);
+
+
+#if SPI_ASYNC_ENABLED
+
+/* Starts an interrupt driven transfer of 'length' bytes with the device, as SPI_Acquire() - SPI_TransferBuf() -
+ * SPI_Release() would do: mode and clock rate of the device are set, and its CS is LOW for the transfer.
+ *	dev - Device initialized with SPI_Device_Init()
+ *	tx - Bytes to send (NULL to send 0x00)
+ *	rx - Buffer for received bytes (NULL to discard)
+ *	callback - Called at the end of transfer, may start another transfer (NULL if not used)
+ *
+ *	Buffers should stay valid until the end of transfer. Polled functions should not be used meanwhile.
+ *
+ *	Returns: 0 - Transfer started
+ *			 1 - Bus busy (transfer in progress or owned with SPI_Acquire), transfer not started
+ */
+uint8_t SPI_Transfer_Async(spi_device_t *dev, const uint8_t *tx, uint8_t *rx, uint16_t length, spi_callback_t callback);
+
+
+/* Returns 1 while an asynchronous transfer is in progress */
+uint8_t SPI_Busy(void);
+
+#endif
+
+#endif
@@ -1,6 +1,10 @@
 #include <avr/io.h>
 #include <util/twi.h>
 #include <avr/interrupt.h>
+#include <util/delay.h>
+#include <util/delay_basic.h>
+#include <avr/sleep.h>
+#define AVR_TWI_IMPL	/* Hardware TWI functions are defined here, even when TWI_BUS_SOFT is defined */
 #include "avr_twi.h"
 
 //#define TWI_DEBUG
@@ -21,8 +25,89 @@
 	#define RED_LED_TOGGLE()
 #endif
 
+/* SCL and SDA pins, used for bus recovery when the TWI module is disabled */
+#if !defined(TWI_SCL_BIT)
+#if defined(__AVR_ATmega8__) || defined(__AVR_ATmega8A__) || defined(__AVR_ATmega48__) || defined(__AVR_ATmega48A__) \
+	|| defined(__AVR_ATmega48P__) || defined(__AVR_ATmega48PA__) || defined(__AVR_ATmega88__) || defined(__AVR_ATmega88A__) \
+	|| defined(__AVR_ATmega88P__) || defined(__AVR_ATmega88PA__) || defined(__AVR_ATmega168__) || defined(__AVR_ATmega168A__) \
+	|| defined(__AVR_ATmega168P__) || defined(__AVR_ATmega168PA__) || defined(__AVR_ATmega328__) || defined(__AVR_ATmega328P__) \
+	|| defined(__AVR_ATmega328PB__)
+	#define TWI_PORT			PORTC
+	#define TWI_DDR				DDRC
+	#define TWI_PIN				PINC
+	#define TWI_SCL_BIT			PC5
+	#define TWI_SDA_BIT			PC4
+#elif defined(__AVR_ATmega16__) || defined(__AVR_ATmega16A__) || defined(__AVR_ATmega32__) || defined(__AVR_ATmega32A__) \
+	|| defined(__AVR_ATmega164A__) || defined(__AVR_ATmega164P__) || defined(__AVR_ATmega164PA__) || defined(__AVR_ATmega324A__) \
+	|| defined(__AVR_ATmega324P__) || defined(__AVR_ATmega324PA__) || defined(__AVR_ATmega644__) || defined(__AVR_ATmega644A__) \
+	|| defined(__AVR_ATmega644P__) || defined(__AVR_ATmega644PA__) || defined(__AVR_ATmega1284__) || defined(__AVR_ATmega1284P__)
+	#define TWI_PORT			PORTC
+	#define TWI_DDR				DDRC
+	#define TWI_PIN				PINC
+	#define TWI_SCL_BIT			PC0
+	#define TWI_SDA_BIT			PC1
+#elif defined(__AVR_ATmega64__) || defined(__AVR_ATmega128__) || defined(__AVR_ATmega1280__) || defined(__AVR_ATmega1281__) \
+	|| defined(__AVR_ATmega2560__) || defined(__AVR_ATmega2561__)
+	#define TWI_PORT			PORTD
+	#define TWI_DDR				DDRD
+	#define TWI_PIN				PIND
+	#define TWI_SCL_BIT			PD0
+	#define TWI_SDA_BIT			PD1
+#else
+	#error "SCL/SDA pins not known for this MCU. Please define TWI_PORT, TWI_DDR, TWI_PIN, TWI_SCL_BIT and TWI_SDA_BIT"
+#endif
+#endif
+
+#define SCL_LOW()				(TWI_DDR |= (1 << TWI_SCL_BIT))		/* Pin is driven low as output (PORT bit = 0) */
+#define SCL_RELEASE()			(TWI_DDR &= ~(1 << TWI_SCL_BIT))	/* Pin is pulled high by the bus pull-up as input */
+#define SDA_LOW()				(TWI_DDR |= (1 << TWI_SDA_BIT))
+#define SDA_RELEASE()			(TWI_DDR &= ~(1 << TWI_SDA_BIT))
+#define SDA_STATE()				(TWI_PIN & (1 << TWI_SDA_BIT))
+#define SCL_STATE()				(TWI_PIN & (1 << TWI_SCL_BIT))
+
+#define TWI_RECOVER_HALF_US		5		/* Half period of recovery clock (100kHz) */
+
+/* Iterations of the polling loop in TWI_TIMEOUT_US */
+#define TWI_TIMEOUT_SPINS		(TWI_TIMEOUT_US * (F_CPU / 1000000UL) / TWI_SPIN_CYCLES)
+#if TWI_TIMEOUT_US && (TWI_TIMEOUT_SPINS > 65535)
+	#error "TWI_TIMEOUT_US is too long for the 16-bit polling count, increase TWI_SPIN_CYCLES"
+#endif
+
+#if TWI_SLEEP_WAIT && TWI_SLEEP_TIMEOUT_TICKS && !defined(TWI_SLEEP_TIME)
+	#error "TWI_SLEEP_TIMEOUT_TICKS needs the tick count TWI_SLEEP_TIME() of a periodic interrupt"
+#endif
+
 static volatile uint8_t  twi_status = TWI_STATUS_DONE;
+static volatile uint8_t	 _twi_activity;	/* Set on every TWI interrupt, used for timeout of blocking transfer */
+static volatile uint8_t	 _twi_sync_status;	/* Result of the blocking transfer */
+static twi_callback_t	_twi_callback;	/* Called at the end of current transfer */
 static twi_params_t		_twi_params; /* Local structure to copy the parameters from caller */
+static twi_params_t		_twi_request; /* Unmodified parameters, to restart the transfer after arbitration loss */
+static const uint8_t	*_twi_prefix; /* Next prefix byte to be sent */
+static uint8_t			_twi_arb_retries;	/* Remaining retries after arbitration loss */
+static uint8_t			_twi_retry_pending;	/* Retry to be started after the slave transaction (arbitration lost to a host addressing us) */
+
+/* Slave mode register bank */
+static volatile uint8_t	*_slv_regs;		/* Register bank served to the host */
+static uint8_t			_slv_size;		/* Number of registers in bank */
+static uint8_t			_slv_writable;	/* Registers [0, _slv_writable) can be written by host */
+static uint8_t			_slv_ptr;		/* Auto-incrementing register pointer */
+static uint8_t			_slv_expect_ptr;	/* Next received byte is the register pointer */
+static volatile uint8_t	_slv_active;	/* Slave transaction in progress */
+static volatile uint8_t	_slv_written;	/* Host wrote to registers since last TWI_Slave_Written() */
+static uint8_t			_twi_ea;		/* _BV(TWEA) when slave mode is enabled, to keep responding to own address */
+
+/* Bus scan result : bit (addr & 7) of _twi_present[addr >> 3] is set if a device acknowledged */
+static uint8_t			_twi_present[16];
+static uint8_t			_twi_scanned;
+
+#if TWI_STATS_ENABLED
+static twi_stats_t		_twi_stats;
+static uint16_t			_twi_start_time;	/* TWI_STATS_TIME() at start of current transfer */
+	#define STATS_INC(field)		(_twi_stats.field++)
+#else
+	#define STATS_INC(field)
+#endif
 
 
 /* Initialize TWI module */
@@ -49,79 +134,232 @@ void TWI_Init(void)
 #endif
 }
 
-/* TWI transfer API */
-twi_status_t TWI_Master_Transfer(twi_params_t *params)
+/* Ends the current master transfer with given status */
+static void twi_done(twi_status_t status)
 {
-	/* Previous transfer complete ? */
-	if(twi_status == TWI_STATUS_BUSY) {
-		return TWI_STATUS_BUSY;
+	twi_callback_t callback = _twi_callback;
+
+	twi_status = status;
+#if TWI_STATS_ENABLED
+	uint16_t ticks = TWI_STATS_TIME() - _twi_start_time;
+	uint8_t bin = 0;
+
+	_twi_stats.transfers++;
+	if(status == TWI_STATUS_NOACK) {
+		_twi_stats.nacks++;
+	}
+	else if(status == TWI_STATUS_BUSERROR) {
+		_twi_stats.bus_errors++;
+	}
+	else if(status == TWI_STATUS_TIMEOUT) {
+		_twi_stats.timeouts++;
+	}
+	/* bin = log2(ticks) */
+	while((ticks >>= 1) && (bin < (TWI_STATS_HIST_BINS - 1))) {
+		bin++;
+	}
+	_twi_stats.latency[bin]++;
+#endif
+	/* Callback may start the next transfer. TWCR is already written for the current one */
+	if(callback) {
+		_twi_callback = 0;
+		callback(status);
 	}
-	
-	/* Set parameters for the current transfer */
-	twi_status = TWI_STATUS_BUSY;
-	_twi_params = *params;
-	RED_LED_ON();
-	/* Send start condition */
-	TWCR = _BV(TWINT)|_BV(TWEA)|_BV(TWSTA)|_BV(TWEN)|_BV(TWIE); // Enable interrupt as well 
-	
-	while(twi_status == TWI_STATUS_BUSY)
-		;
-	RED_LED_OFF();
-	return twi_status;
 }
 
 
-/* TWI Non-blocking transfer API (NOT IMPLEMENTED) */
-uint8_t TWI_Master_Transfer_NB(twi_params_t *params)
+/* Copy parameters and send start condition
+ *	Returns 1 if a master transfer or slave transaction is in progress
+ */
+static uint8_t twi_start(twi_params_t *params, twi_callback_t callback)
 {
-	/* Previous transfer complete ? */
-	if(twi_status == TWI_STATUS_BUSY) {
+	uint8_t sreg = SREG;
+
+	cli();
+	/* Previous transfer complete? Not addressed as slave? */
+	if((twi_status == TWI_STATUS_BUSY) || _slv_active || (_twi_ea && (TWCR & _BV(TWINT)))) {
+		SREG = sreg;
 		return 1;
 	}
-	
 	/* Set parameters for the current transfer */
 	twi_status = TWI_STATUS_BUSY;
-	_twi_params = *params;
+	_twi_request = *params;
+	_twi_params = _twi_request;
+	_twi_prefix = _twi_params.tx_prefix;
+	_twi_arb_retries = TWI_ARB_RETRIES;
+	_twi_callback = callback;
+#if TWI_STATS_ENABLED
+	_twi_start_time = TWI_STATS_TIME();
+#endif
 	RED_LED_ON();
+	/* A START written before the STOP of the previous transfer is sent would become a repeated START */
+	while(TWCR & _BV(TWSTO))
+		;
 	/* Send start condition */
 	TWCR = _BV(TWINT)|_BV(TWEA)|_BV(TWSTA)|_BV(TWEN)|_BV(TWIE); // Enable interrupt as well 
+	SREG = sreg;
 	return 0;
 }
 
 
+/* Waits while *status is TWI_STATUS_BUSY
+ *	If there is no TWI interrupt for TWI_TIMEOUT_US (TWI_SLEEP_TIMEOUT_TICKS in sleep mode), the bus is
+ *	recovered, which ends the current transfer
+ */
+static void twi_wait(volatile uint8_t *status)
+{
+#if TWI_SLEEP_WAIT
+	uint8_t sreg = SREG;
+#if TWI_SLEEP_TIMEOUT_TICKS
+	uint16_t last;
+#endif
+
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	_twi_activity = 0;
+#if TWI_SLEEP_TIMEOUT_TICKS
+	last = TWI_SLEEP_TIME();
+#endif
+	while(*status == TWI_STATUS_BUSY) {
+		/* Status is checked with interrupts disabled. The instruction after sei() is executed before any
+		 * pending interrupt, so an interrupt ending the transfer here can only wake up the sleep.
+		 */
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+#if TWI_SLEEP_TIMEOUT_TICKS
+		/* Woken up: time since the last TWI interrupt */
+		if(_twi_activity) {
+			_twi_activity = 0;
+			last = TWI_SLEEP_TIME();
+		}
+		else if((uint16_t)(TWI_SLEEP_TIME() - last) > TWI_SLEEP_TIMEOUT_TICKS) {
+			sei();
+			TWI_Bus_Recover();
+			break;
+		}
+#endif
+	}
+	SREG = sreg;
+#elif TWI_TIMEOUT_US
+	uint16_t idle = 0;
+
+	_twi_activity = 0;
+	while(*status == TWI_STATUS_BUSY) {
+		if(_twi_activity) {
+			_twi_activity = 0;
+			idle = 0;
+		}
+		else if(++idle > TWI_TIMEOUT_SPINS) {
+			/* No interrupt for too long : bus is stuck */
+			TWI_Bus_Recover();
+			break;
+		}
+		_delay_loop_1(1);
+	}
+#else
+	while(*status == TWI_STATUS_BUSY)
+		;
+#endif
+}
+
+
+/* Result of blocking transfer, called from twi_done() */
+static void twi_sync_done(twi_status_t status)
+{
+	_twi_sync_status = status;
+}
+
+
+/* TWI transfer API */
+twi_status_t TWI_Master_Transfer(twi_params_t *params)
+{
+	_twi_sync_status = TWI_STATUS_BUSY;
+	/* Wait for a non-blocking transfer or slave transaction to finish */
+	while(twi_start(params, twi_sync_done)) {
+		twi_wait(&twi_status);
+	}
+	twi_wait(&_twi_sync_status);
+	RED_LED_OFF();
+	return _twi_sync_status;
+}
+
+
+/* TWI Non-blocking transfer API */
+uint8_t TWI_Master_Transfer_NB(twi_params_t *params)
+{
+	return twi_start(params, 0);
+}
+
+
+uint8_t TWI_Master_Transfer_Async(twi_params_t *params, twi_callback_t callback)
+{
+	return twi_start(params, callback);
+}
+
+
 twi_status_t TWI_Master_Status(void)
 {
 	return twi_status;
 }
 
 
+/* Arbitration lost: restart transfer from the beginning, if retries remain
+ *	Returns TWSTA bit to request START when the bus becomes free, 0 if transfer has failed (caller ends it)
+ */
+static uint8_t twi_arb_retry(void)
+{
+	STATS_INC(arb_lost);
+	if(_twi_arb_retries) {
+		_twi_arb_retries--;
+		_twi_params = _twi_request;
+		_twi_prefix = _twi_params.tx_prefix;
+		return _BV(TWSTA);
+	}
+	return 0;
+}
+
+
 /* ISR of TWI interrupt */
 ISR(TWI_vect)
 {
 	uint8_t 	twst;
+	uint8_t		sta;
+	uint8_t		done = TWI_STATUS_BUSY;	/* Set to end the master transfer after TWCR is written */
 	
+	_twi_activity = 1;
 	/* Check TWI status */
 	switch(twst = TW_STATUS) {
 		case TW_START:  /* start condition is transmitted, now transmit SLA+R/W */
 		case TW_REP_START : /* Repeated start: transmit SLA+R/W */
-			TWDR = (_twi_params.slave_addr << 1) | (_twi_params.tx_count == 0);
+			/* Read if nothing (more) to write. An empty transfer is sent as SLA+W (address probe) */
+			TWDR = (_twi_params.slave_addr << 1) | (((_twi_params.tx_count | _twi_params.tx_prefix_count) == 0) && _twi_params.rx_count);
 			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE);
 			break;
 			
 		case TW_MT_SLA_ACK: /* SLA+W / data has been transmitted and ACK received : Transmit further data or send START or STOP */
 		case TW_MT_DATA_ACK:
-			if(_twi_params.tx_count) { /* Transmit remaining byte(s) */
+			if(_twi_params.tx_prefix_count) { /* Transmit prefix byte(s) first */
+				TWDR = *_twi_prefix++;
+				_twi_params.tx_prefix_count--;
+				TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE);
+				STATS_INC(bytes);
+			}
+			else if(_twi_params.tx_count) { /* Transmit remaining byte(s) */
 				TWDR = *_twi_params.tx_buf++;
 				_twi_params.tx_count--;
 				TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE);
+				STATS_INC(bytes);
 			}
 			else {
 				if(_twi_params.rx_count) {	
 					TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWSTA); /* send START if data to be read */ 
 				}
 				else {
-					TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWSTO); /* otherwise STOP to finish transfer */
-					twi_status = TWI_STATUS_DONE;
+					TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWSTO)|_twi_ea; /* otherwise STOP to finish transfer */
+					done = TWI_STATUS_DONE;
 				}
 			}
 			break;
@@ -136,39 +374,122 @@ ISR(TWI_vect)
 			break;
 			
 		case TW_MR_DATA_ACK: /* Data byte received and ACK sent: Receive next byte(s) with ACK/NACK */
+			*_twi_params.rx_buf++ = TWDR;
+			_twi_params.rx_count--;
+			STATS_INC(bytes);
 			if(_twi_params.rx_count == 1) {
 				TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE);  /* Dont ACK if last byte to be received */
 			}
 			else {
 				TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWEA); /* Receive data with ACK */
 			}
-			*_twi_params.rx_buf++ = TWDR;
-			_twi_params.rx_count--;
 			break;
 			
-		case TW_MR_DATA_NACK: /* Data byte received and no ACK sent: Send STOP to finish transfer */
-			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWSTO);
-			twi_status = TWI_STATUS_DONE;
+		case TW_MR_DATA_NACK: /* Last data byte received and no ACK sent: Send STOP to finish transfer */
+			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWSTO)|_twi_ea;
+			*_twi_params.rx_buf++ = TWDR;
+			_twi_params.rx_count--;
+			STATS_INC(bytes);
+			done = TWI_STATUS_DONE;
 			break;
 			
 		/* NACK conditions */
 		case TW_MR_SLA_NACK:  /* SLA+R transmitted, NACK received */
 		case TW_MT_SLA_NACK:  /* SLA+W transmitted, ACK received */
 		case TW_MT_DATA_NACK: /* data transmitted, NACK received */
-			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWSTO);
-			twi_status = TWI_STATUS_NOACK;
+			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWSTO)|_twi_ea;
+			done = TWI_STATUS_NOACK;
 			break;
 			
-		case TW_MT_ARB_LOST:  /* arbitration lost in SLA+W or data : Release TWI bus*/
-			twi_status = TWI_STATUS_ARBLOST;
-			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE);  
+		case TW_MT_ARB_LOST:  /* arbitration lost in SLA+W or data : Release TWI bus and retry when bus is free */
+			sta = twi_arb_retry();
+			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_twi_ea|sta;
+			if(!sta) {
+				done = TWI_STATUS_ARBLOST;
+			}
 			break;
 		case TW_BUS_ERROR: /* Bus error : send STOP */
-			twi_status = TWI_STATUS_BUSERROR;
-			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWSTO);
+			_slv_active = 0;
+			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWSTO)|_twi_ea;
+			if(twi_status == TWI_STATUS_BUSY) {
+				done = TWI_STATUS_BUSERROR;
+			}
+			break;
+			
+		/* Slave receiver */
+		case TW_SR_ARB_LOST_SLA_ACK: /* Arbitration lost as master and addressed for write : retry after slave transaction */
+			_twi_retry_pending = twi_arb_retry();
+			if(!_twi_retry_pending) {
+				done = TWI_STATUS_ARBLOST;	/* Ended after _slv_active is set, so the callback can't start a transfer */
+			}
+			/* no break */
+		case TW_SR_SLA_ACK: /* Own SLA+W received and ACK returned : first data byte is the register pointer */
+			_slv_active = 1;
+			_slv_expect_ptr = 1;
+			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWEA);
+			break;
+			
+		case TW_SR_DATA_ACK: /* Data received and ACK returned : Set pointer or write register */
+			if(_slv_expect_ptr) {
+				_slv_expect_ptr = 0;
+				_slv_ptr = TWDR;
+				if(_slv_ptr >= _slv_size) { /* Pointer out of range: reset it and NACK the following data */
+					_slv_ptr = 0;
+					TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE);
+					break;
+				}
+			}
+			else {
+				if(_slv_ptr < _slv_writable) {
+					_slv_regs[_slv_ptr] = TWDR;
+					_slv_written = 1;
+				}
+				if(++_slv_ptr >= _slv_size) {
+					_slv_ptr = 0;
+				}
+			}
+			/* ACK the next byte only if it goes to a writable register */
+			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|((_slv_ptr < _slv_writable) ? _BV(TWEA) : 0);
+			break;
+			
+		case TW_SR_DATA_NACK: /* Data received and NACK returned */
+		case TW_SR_STOP: /* STOP or Repeated START received : end of host write */
+			_slv_active = 0;
+			sta = _twi_retry_pending;
+			_twi_retry_pending = 0;
+			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWEA)|sta;
+			break;
+			
+		/* Slave transmitter */
+		case TW_ST_ARB_LOST_SLA_ACK: /* Arbitration lost as master and addressed for read : retry after slave transaction */
+			_twi_retry_pending = twi_arb_retry();
+			if(!_twi_retry_pending) {
+				done = TWI_STATUS_ARBLOST;	/* Ended after _slv_active is set, so the callback can't start a transfer */
+			}
+			/* no break */
+		case TW_ST_SLA_ACK: /* Own SLA+R received and ACK returned : send register at pointer */
+			_slv_active = 1;
+			/* no break */
+		case TW_ST_DATA_ACK: /* Data transmitted and ACK received : send next register */
+			TWDR = _slv_regs[_slv_ptr];
+			if(++_slv_ptr >= _slv_size) {
+				_slv_ptr = 0;
+			}
+			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWEA);
+			break;
+			
+		case TW_ST_DATA_NACK: /* Data transmitted and NACK received : end of host read */
+		case TW_ST_LAST_DATA:
+			_slv_active = 0;
+			sta = _twi_retry_pending;
+			_twi_retry_pending = 0;
+			TWCR = _BV(TWINT)|_BV(TWEN)|_BV(TWIE)|_BV(TWEA)|sta;
 			break;
 	}
-	
+	/* Last, as the callback may start the next transfer */
+	if(done != TWI_STATUS_BUSY) {
+		twi_done(done);
+	}
 }
 
 
@@ -178,3 +499,152 @@ void TWI_Reset(void)
     TWCR &= ~(_BV(TWSTO)|_BV(TWEN));
     TWCR |= _BV(TWEN);
 }
+
+
+/* Clock out a stuck slave and send STOP */
+twi_status_t TWI_Bus_Recover(void)
+{
+	uint8_t i, sreg;
+	uint8_t port = TWI_PORT & ((1 << TWI_SCL_BIT)|(1 << TWI_SDA_BIT));
+	twi_status_t ret = TWI_STATUS_DONE;
+
+	/* Disable TWI module, pins are now controlled by PORT/DDR */
+	TWCR = 0;
+	TWI_PORT &= ~((1 << TWI_SCL_BIT)|(1 << TWI_SDA_BIT));
+	SDA_RELEASE();
+	SCL_RELEASE();
+	_delay_us(TWI_RECOVER_HALF_US);
+
+	/* Clock SCL until slave releases SDA (it has at most 8 data bits + ACK to finish) */
+	for(i = 0; (i < 9) && !SDA_STATE(); i++) {
+		SCL_LOW();
+		_delay_us(TWI_RECOVER_HALF_US);
+		SCL_RELEASE();
+		_delay_us(TWI_RECOVER_HALF_US);
+	}
+
+	/* STOP condition : SDA low to high while SCL is high */
+	SCL_LOW();
+	_delay_us(TWI_RECOVER_HALF_US);
+	SDA_LOW();
+	_delay_us(TWI_RECOVER_HALF_US);
+	SCL_RELEASE();
+	_delay_us(TWI_RECOVER_HALF_US);
+	SDA_RELEASE();
+	_delay_us(TWI_RECOVER_HALF_US);
+
+	if(!SDA_STATE() || !SCL_STATE()) {
+		ret = TWI_STATUS_BUSERROR;
+	}
+
+	/* Restore pull-up setting and re-initialize TWI. The transfer state is reset and the aborted transfer
+	 * ended with interrupts disabled, as twi_done() is in the ISR: the callback runs in the same context.
+	 */
+	sreg = SREG;
+	cli();
+	TWI_PORT |= port;
+	TWI_Init();
+	_slv_active = 0;
+	_twi_retry_pending = 0;
+	TWCR = _twi_ea ? (_BV(TWEN)|_BV(TWIE)|_BV(TWEA)) : _BV(TWEN);
+
+	if(twi_status == TWI_STATUS_BUSY) {
+		twi_done(TWI_STATUS_TIMEOUT);
+	}
+	SREG = sreg;
+
+	return ret;
+}
+
+
+uint8_t TWI_Scan(void)
+{
+	twi_params_t params = {0};
+	uint8_t count = 0;
+	uint8_t addr;
+
+	for(addr = 0x08; addr <= 0x77; addr++) {
+		params.slave_addr = addr;
+		if(TWI_Master_Transfer(&params) == TWI_STATUS_DONE) {
+			_twi_present[addr >> 3] |= (1 << (addr & 7));
+			count++;
+		}
+		else {
+			_twi_present[addr >> 3] &= ~(1 << (addr & 7));
+		}
+	}
+	_twi_scanned = 1;
+	return count;
+}
+
+
+uint8_t TWI_Device_Present(uint8_t slave_addr)
+{
+	twi_params_t params = {0};
+
+	if(_twi_scanned) {
+		return (_twi_present[(slave_addr >> 3) & 0xF] >> (slave_addr & 7)) & 1;
+	}
+	params.slave_addr = slave_addr;
+	return (TWI_Master_Transfer(&params) == TWI_STATUS_DONE);
+}
+
+
+/* Enable slave mode with register bank */
+uint8_t TWI_Slave_Init(uint8_t slave_addr, volatile uint8_t *regs, uint8_t size, uint8_t writable)
+{
+	uint8_t sreg = SREG;
+
+	if(!size || (writable > size)) {
+		return 1;
+	}
+	cli();
+	_slv_regs = regs;
+	_slv_size = size;
+	_slv_writable = writable;
+	_slv_ptr = 0;
+	_slv_active = 0;
+	_slv_written = 0;
+	_twi_ea = _BV(TWEA);
+	TWAR = (slave_addr << 1);	/* General call not recognized */
+	TWCR = _BV(TWEN)|_BV(TWIE)|_BV(TWEA);
+	SREG = sreg;
+	return 0;
+}
+
+
+uint8_t TWI_Slave_Written(void)
+{
+	uint8_t written = _slv_written;
+
+	if(written) {
+		_slv_written = 0;
+	}
+	return written;
+}
+
+
+#if TWI_STATS_ENABLED
+void TWI_Stats_Get(twi_stats_t *stats)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+	*stats = _twi_stats;
+	SREG = sreg;
+}
+
+
+void TWI_Stats_Reset(void)
+{
+	uint8_t sreg = SREG;
+	uint8_t *ptr = (uint8_t *)&_twi_stats;
+	uint8_t i;
+
+	cli();
+	for(i = 0; i < sizeof(_twi_stats); i++) {
+		*ptr++ = 0;
+	}
+	SREG = sreg;
+}
+#endif
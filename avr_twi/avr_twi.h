@@ -3,6 +3,9 @@
  *
  */
 
+#ifndef AVR_TWI_H
+#define AVR_TWI_H
+
 #include <stdint.h>
 
 /* Different status of TWI transfer */
@@ -10,20 +13,99 @@ typedef enum  {
 	TWI_STATUS_DONE = 0,  	/* This status indicates success of a transfer */
 	TWI_STATUS_BUSY,	  	/* This is the initial value of status when starting a transfer */
 	TWI_STATUS_NOACK, 	  	/* This indicates error status, due to the no acknowldge */
-	TWI_STATUS_ARBLOST, 	/* This indicates error status, due to arbitration loss */ 
-	TWI_STATUS_BUSERROR
+	TWI_STATUS_ARBLOST, 	/* This indicates error status, due to arbitration loss (after TWI_ARB_RETRIES retries) */ 
+	TWI_STATUS_BUSERROR,
+	TWI_STATUS_TIMEOUT		/* This indicates the bus made no progress within TWI_TIMEOUT_US (bus recovery was performed) */
 } twi_status_t;
 
+
+/* Maximum time (in us) a blocking transfer may go without any TWI interrupt before it is aborted
+ * with TWI_STATUS_TIMEOUT and the bus is recovered. The time is restarted on every interrupt, so long
+ * transfers (eg: OLED data) are not affected. The value is approximate. Define to 0 to wait forever.
+ */
+#ifndef TWI_TIMEOUT_US
+#define TWI_TIMEOUT_US			2000
+#endif
+
+/* CPU cycles of one iteration of the timeout polling loop (status checks, count and _delay_loop_1(1)).
+ * The loop has no other delay, so a blocking transfer returns within a few cycles of its last interrupt.
+ */
+#ifndef TWI_SPIN_CYCLES
+#define TWI_SPIN_CYCLES			16
+#endif
+
+/* Define to 1 to put the CPU in idle sleep between TWI interrupts of a blocking transfer, instead of polling.
+ * TWI_TIMEOUT_US is not used then: without TWI_SLEEP_TIMEOUT_TICKS, a stuck bus is never detected.
+ */
+#ifndef TWI_SLEEP_WAIT
+#define TWI_SLEEP_WAIT			0
+#endif
+
+/* Timeout in TWI_SLEEP_WAIT mode, in ticks of TWI_SLEEP_TIME() with no TWI interrupt (0 to wait forever).
+ * TWI_SLEEP_TIME() must return a 16-bit tick count incremented by a periodic interrupt of the application
+ * (eg: a millisecond counter), which also wakes up the CPU to check the time. Other interrupts don't count.
+ * The timeout is between TWI_SLEEP_TIMEOUT_TICKS and TWI_SLEEP_TIMEOUT_TICKS + 1 tick periods.
+ */
+#ifndef TWI_SLEEP_TIMEOUT_TICKS
+#define TWI_SLEEP_TIMEOUT_TICKS	0
+#endif
+
+/* Number of times a transfer is restarted after losing arbitration to another master, before
+ * failing with TWI_STATUS_ARBLOST. The restart START is sent by the TWI hardware when the bus becomes free.
+ */
+#ifndef TWI_ARB_RETRIES
+#define TWI_ARB_RETRIES			3
+#endif
+
+/* Maximum number of prefix bytes (register address/control byte) sent before tx_buf */
+#ifndef TWI_PREFIX_MAX
+#define TWI_PREFIX_MAX			2
+#endif
+
 /* Parameters defining a transfer, passed to the TWI transfer API */
 typedef struct {
 	uint8_t 		slave_addr;		/* Slave address for the transfer, should contain 7-bit slave address in bits [6:0] */
-	uint8_t 		*tx_buf;		/* Buffer containing data to be transmitted to slave */
+	const uint8_t 	*tx_buf;		/* Buffer containing data to be transmitted to slave */
 	uint8_t 		tx_count;		/* Number of bytes to be transmitted to slave */
 	uint8_t 		*rx_buf;		/* Buffer to store data received from slave */
 	uint8_t			rx_count;		/* Number of bytes to be received from slave */
+	uint8_t			tx_prefix[TWI_PREFIX_MAX];	/* Bytes sent before tx_buf, eg: register address or control byte */
+	uint8_t			tx_prefix_count;			/* Number of prefix bytes (0 if not used) */
 } twi_params_t;
 
 
+/* Optional transfer statistics (TWI_Stats_Get). Define to 1 to enable */
+#ifndef TWI_STATS_ENABLED
+#define TWI_STATS_ENABLED		0
+#endif
+
+/* Timer count used to measure transfer time for the latency histogram. The timer should be
+ * running freely (eg: Timer1 with a prescaler), histogram values are in its ticks.
+ */
+#ifndef TWI_STATS_TIME
+#define TWI_STATS_TIME()		TCNT1
+#endif
+
+/* Number of latency histogram bins */
+#ifndef TWI_STATS_HIST_BINS
+#define TWI_STATS_HIST_BINS		12
+#endif
+
+/* Function called at the end of a transfer started by TWI_Master_Transfer_Async() (from interrupt context) */
+typedef void (*twi_callback_t)(twi_status_t status);
+
+/* Statistics of master transfers since TWI_Stats_Reset() */
+typedef struct {
+	uint16_t		transfers;		/* Completed transfers (any status) */
+	uint32_t		bytes;			/* Data bytes transmitted and received (prefix included, SLA not included) */
+	uint16_t		nacks;			/* Transfers ended by NACK from slave */
+	uint16_t		arb_lost;		/* Arbitration losses, including the ones recovered by retry */
+	uint16_t		bus_errors;		/* Transfers ended by bus error */
+	uint16_t		timeouts;		/* Transfers ended by timeout */
+	uint16_t		latency[TWI_STATS_HIST_BINS];	/* Transfer time: bin n counts transfers of 2^n to 2^(n+1)-1 ticks (bin 0 includes 0 ticks, last bin includes all longer transfers) */
+} twi_stats_t;
+
+
 /* Initialize TWI bus - This will set the clock frequency to 100 kHz */
 void TWI_Init(void);
 
@@ -32,19 +114,26 @@ void TWI_Init(void);
  *			slave_addr - 7 bit slave address in [6:0]
  *			tx_buf, tx_count - Valid tx buffer address and count (NULL/0 if no tx)
  *			rx_buf, rx_count - Valid rx buffer address and count (NULL/0 if no rx)
+ *			tx_prefix, tx_prefix_count - Bytes to be sent ahead of tx_buf (0 count if not used)
+ *
+ *		The prefix allows a register address or control byte to be sent along with data from
+ *		a separate buffer (eg: display framebuffer), without copying them together.
+ *
+ *		If a non-blocking transfer (or slave transaction) is in progress, it waits for it to finish first.
+ *		With all counts 0, only SLA+W is sent (address probe): TWI_STATUS_DONE if the slave acknowledged.
  *
  *		Returns: Final status of the transfer(0 = success)
  */
 twi_status_t TWI_Master_Transfer(twi_params_t *params);
 
 
-/* (NOT IMPLEMENTED)
- * Performs a Non-blocking TWI transfer, based on parameters passed.
+/* Performs a Non-blocking TWI transfer, based on parameters passed.
  * Before calling, use TWI_Master_Status() to make sure TWI is currently NOT busy
  *		The twi_params_t struct should have following members initialized:
  *			slave_addr - 7 bit slave address in [6:0]
  *			tx_buf, tx_count - Valid tx buffer address and count (NULL/0 if no tx)
  *			rx_buf, rx_count - Valid rx buffer address and count (NULL/0 if no rx)
+ *			tx_prefix, tx_prefix_count - Bytes to be sent ahead of tx_buf (0 count if not used)
  *
  *		Returns: 0 = TWI transfer started
  *				 1 = TWI is busy and transfer is cancelled
@@ -52,14 +141,94 @@ twi_status_t TWI_Master_Transfer(twi_params_t *params);
 uint8_t TWI_Master_Transfer_NB(twi_params_t *params);
 
 
+/* Non-blocking TWI transfer, with 'callback' called from the TWI interrupt when the transfer ends
+ *	The callback can start another transfer: it runs after the STOP of the ended transfer is requested, and the
+ *	next START waits (a few us) until the STOP is sent. Parameters and return value are same as TWI_Master_Transfer_NB()
+ */
+uint8_t TWI_Master_Transfer_Async(twi_params_t *params, twi_callback_t callback);
+
+
 /*	Returns current status of TWI 
  *	Use this function with non-blocking TWI transfer to know if the previous transfer is done
  */
 twi_status_t TWI_Master_Status(void);
 
 
+/* Probes all addresses from 0x08 to 0x77 with SLA+W and caches the ones that acknowledged
+ *	Takes about 4ms at 400kHz. Call after TWI_Init(), before the device drivers are initialized.
+ *
+ *		Returns: Number of devices found
+ */
+uint8_t TWI_Scan(void);
+
+
+/* Returns: 1 - Device at 7-bit slave_addr acknowledged its address
+ *			0 - No device
+ *	The result of the last TWI_Scan() is used. Without a scan, the address is probed.
+ */
+uint8_t TWI_Device_Present(uint8_t slave_addr);
+
+
 /* Necessary after waking up from PowerSave/PowerDown sleep modes (Bug) */
 void TWI_Reset(void);
 
 
+/* Copies the statistics of master transfers (TWI_STATS_ENABLED = 1 only) */
+void TWI_Stats_Get(twi_stats_t *stats);
+
+
+/* Clears statistics (TWI_STATS_ENABLED = 1 only) */
+void TWI_Stats_Reset(void);
+
+
+/* Enables TWI slave mode, serving a register bank from RAM
+ *	The AVR acknowledges the 7-bit slave_addr. The first byte of a host write sets the register pointer,
+ *	further bytes are stored in regs[] starting at the pointer. A host read returns regs[] starting at
+ *	the pointer. The pointer increments after each byte and wraps to 0 at 'size'.
+ *	A pointer byte at or beyond 'size' is rejected: the pointer is reset to 0 and the data bytes that
+ *	follow are NACKed (the pointer byte itself is ACKed, the hardware decides before it is received).
+ *	Only registers below 'writable' can be written by the host, the rest are read-only: a data byte
+ *	for a read-only register is NACKed and ignored, which ends the host write.
+ *
+ *	Master transfers can still be started when no slave transaction is in progress (returns busy otherwise).
+ *	Application should update multi-byte values in regs[] with interrupts disabled.
+ *
+ *		Returns: 0 - Slave mode enabled
+ *				 1 - Invalid bank (size is 0 or writable > size), nothing changed
+ */
+uint8_t TWI_Slave_Init(uint8_t slave_addr, volatile uint8_t *regs, uint8_t size, uint8_t writable);
+
+
+/* Returns: 1 - Host has written to the register bank since the last call
+ *			0 - No registers written
+ */
+uint8_t TWI_Slave_Written(void);
+
+
+/* Recovers a bus stuck by a slave holding SDA low
+ *	The TWI module is disabled and up to 9 clock pulses are sent on SCL until the slave releases SDA,
+ *	followed by a STOP condition. The TWI module is then re-initialized.
+ *	This is done automatically on a timeout of the blocking transfer. It can also be called when a
+ *	non-blocking transfer stays busy for too long. A transfer in progress ends with TWI_STATUS_TIMEOUT,
+ *	and its callback is called with interrupts disabled, as from the TWI interrupt.
+ *
+ *		Returns: TWI_STATUS_DONE - Bus is free (SDA and SCL are high)
+ *				 TWI_STATUS_BUSERROR - Bus is still held low
+ */
+twi_status_t TWI_Bus_Recover(void);
+
+
+/* Drivers using this API (ds3231, mpu6050, hmc5883, ssd1306...) can be moved to the bit-banged bus
+ * of soft_twi.c, without modification, by compiling their source file with TWI_BUS_SOFT defined.
+ * This is a build-time switch per source file: the TWI_* calls of that file are renamed to the single
+ * soft_twi bus, and the other files keep using the TWI module. Only TWI_Init, TWI_Master_Transfer and
+ * TWI_Device_Present are available on the soft bus.
+ */
+#if defined(TWI_BUS_SOFT) && !defined(AVR_TWI_IMPL)
+#include "soft_twi.h"
+#define TWI_Init				SoftTWI_Init
+#define TWI_Master_Transfer		SoftTWI_Master_Transfer
+#define TWI_Device_Present		SoftTWI_Device_Present
+#endif
 
+#endif
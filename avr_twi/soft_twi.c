@@ -0,0 +1,247 @@
+/*
+ *	soft_twi.c
+ *
+ *	Bit-banged I2C master for AVR, using any two GPIO pins
+ *
+ *	Lines are driven open-drain: PORT bit is kept 0, and the pin is switched between
+ *	output (LOW) and input (released, pulled HIGH by the bus pull-up).
+ */
+
+#include <avr/io.h>
+#include <util/delay_basic.h>
+#include "soft_twi.h"
+
+/* soft_twi_config.h is project specific and should be present in the project directory */
+#include "soft_twi_config.h"
+
+
+#ifndef SOFT_TWI_FREQ
+#define SOFT_TWI_FREQ			400000UL
+#endif
+
+/* SCL low and high times of a SOFT_TWI_FREQ clock, rounded up (I2C Fast mode: tLOW >= 1.3us, tHIGH >= 0.6us).
+ * The delays alone take these times and the bit loop code adds to them, so SCL never runs faster than
+ * SOFT_TWI_FREQ: the real rate is lower by the loop overhead, which is not compensated.
+ */
+#define SOFT_TWI_LOW_CYCLES		((F_CPU * 13 + SOFT_TWI_FREQ * 25 - 1) / (SOFT_TWI_FREQ * 25))
+#define SOFT_TWI_HIGH_CYCLES	((F_CPU * 12 + SOFT_TWI_FREQ * 25 - 1) / (SOFT_TWI_FREQ * 25))
+
+/* _delay_loop_1() counts (3 cycles each) */
+#define SOFT_TWI_LOW_COUNT		((SOFT_TWI_LOW_CYCLES + 2) / 3)
+#define SOFT_TWI_HIGH_COUNT		((SOFT_TWI_HIGH_CYCLES + 2) / 3)
+
+#if SOFT_TWI_LOW_COUNT > 255
+	#error "SOFT_TWI_FREQ is too low for the 8-bit delay loop"
+#endif
+
+#define DELAY_LOW()				_delay_loop_1(SOFT_TWI_LOW_COUNT)
+#define DELAY_HIGH()			_delay_loop_1(SOFT_TWI_HIGH_COUNT)
+
+/* Cycles of one SCL poll while a slave stretches the clock (SCL read, count and _delay_loop_1(1)) */
+#define SOFT_TWI_POLL_CYCLES	8
+
+/* Number of SCL polls before clock stretching times out */
+#if TWI_TIMEOUT_US
+	#define SOFT_TWI_STRETCH_POLLS	((uint16_t)((F_CPU / 1000000UL) * TWI_TIMEOUT_US / SOFT_TWI_POLL_CYCLES))
+#else
+	#define SOFT_TWI_STRETCH_POLLS	0xFFFF
+#endif
+
+#define SCL_LOW()				(SOFT_TWI_DDR |= (1 << SOFT_TWI_SCL_BIT))
+#define SCL_RELEASE()			(SOFT_TWI_DDR &= ~(1 << SOFT_TWI_SCL_BIT))
+#define SDA_LOW()				(SOFT_TWI_DDR |= (1 << SOFT_TWI_SDA_BIT))
+#define SDA_RELEASE()			(SOFT_TWI_DDR &= ~(1 << SOFT_TWI_SDA_BIT))
+#define SCL_STATE()				(SOFT_TWI_PIN & (1 << SOFT_TWI_SCL_BIT))
+#define SDA_STATE()				(SOFT_TWI_PIN & (1 << SOFT_TWI_SDA_BIT))
+
+/* Release SCL and wait while a slave stretches the clock. Only a failed check leaves the fast path */
+#define SCL_HIGH()				do { SCL_RELEASE(); \
+									if(!SCL_STATE() && wait_scl()) { return TWI_STATUS_TIMEOUT; } \
+								} while(0)
+
+
+
+/* Wait for slave to release SCL. Returns 1 on timeout */
+static uint8_t wait_scl(void)
+{
+	uint16_t polls = SOFT_TWI_STRETCH_POLLS;
+
+	while(!SCL_STATE()) {
+		if(!--polls) {
+			return 1;
+		}
+		_delay_loop_1(1);
+	}
+	return 0;
+}
+
+
+/* START condition: SDA goes low while SCL is high (also used for repeated START)
+ *	A START needs an idle bus (SDA and SCL high), and SDA still high before it is pulled low
+ */
+static twi_status_t send_start(uint8_t repeated)
+{
+	if(!repeated && !(SCL_STATE() && SDA_STATE())) {
+		return TWI_STATUS_BUSERROR;
+	}
+	SDA_RELEASE();
+	DELAY_LOW();
+	SCL_HIGH();
+	DELAY_HIGH();
+	if(!SDA_STATE()) {	/* Another master started first */
+		return TWI_STATUS_ARBLOST;
+	}
+	SDA_LOW();
+	DELAY_HIGH();
+	SCL_LOW();
+	return TWI_STATUS_DONE;
+}
+
+
+/* STOP condition: SDA goes high while SCL is high */
+static twi_status_t send_stop(void)
+{
+	SDA_LOW();
+	DELAY_LOW();
+	SCL_HIGH();
+	DELAY_HIGH();
+	SDA_RELEASE();
+	DELAY_LOW();	/* Bus free time */
+	return TWI_STATUS_DONE;
+}
+
+
+/* Sends a byte MSB first and returns the ACK status. SCL is low on entry and exit */
+static twi_status_t write_byte(uint8_t byte)
+{
+	uint8_t mask;
+
+	for(mask = 0x80; mask; mask >>= 1) {
+		if(byte & mask) {
+			SDA_RELEASE();
+		}
+		else {
+			SDA_LOW();
+		}
+		DELAY_LOW();
+		SCL_HIGH();
+		if((byte & mask) && !SDA_STATE()) {	/* Another master is driving SDA low */
+			SCL_RELEASE();
+			return TWI_STATUS_ARBLOST;
+		}
+		DELAY_HIGH();
+		SCL_LOW();
+	}
+
+	/* 9th clock: slave drives ACK */
+	SDA_RELEASE();
+	DELAY_LOW();
+	SCL_HIGH();
+	mask = SDA_STATE();
+	DELAY_HIGH();
+	SCL_LOW();
+
+	return mask ? TWI_STATUS_NOACK : TWI_STATUS_DONE;
+}
+
+
+/* Receives a byte MSB first, and sends ACK (ack = 1) or NACK (ack = 0) */
+static twi_status_t read_byte(uint8_t *data, uint8_t ack)
+{
+	uint8_t byte = 0;
+	uint8_t cnt;
+
+	SDA_RELEASE();
+	for(cnt = 8; cnt; cnt--) {
+		DELAY_LOW();
+		SCL_HIGH();
+		byte <<= 1;
+		if(SDA_STATE()) {
+			byte |= 1;
+		}
+		DELAY_HIGH();
+		SCL_LOW();
+	}
+	*data = byte;
+
+	if(ack) {
+		SDA_LOW();
+	}
+	DELAY_LOW();
+	SCL_HIGH();
+	DELAY_HIGH();
+	SCL_LOW();
+	SDA_RELEASE();
+
+	return TWI_STATUS_DONE;
+}
+
+
+
+void SoftTWI_Init(void)
+{
+	/* PORT bits stay 0: pins are only ever driven low */
+	SOFT_TWI_PORT &= ~((1 << SOFT_TWI_SCL_BIT)|(1 << SOFT_TWI_SDA_BIT));
+	SDA_RELEASE();
+	SCL_RELEASE();
+}
+
+
+twi_status_t SoftTWI_Master_Transfer(twi_params_t *params)
+{
+	twi_status_t status;
+	const uint8_t *ptr;
+	uint8_t count;
+
+	status = send_start(0);
+	if(status) {
+		goto release;
+	}
+
+	/* Write phase: SLA+W, prefix and tx data (SLA+W alone if there is nothing to read either) */
+	if(params->tx_prefix_count || params->tx_count || !params->rx_count) {
+		status = write_byte(params->slave_addr << 1);
+		for(ptr = params->tx_prefix, count = params->tx_prefix_count; !status && count; count--) {
+			status = write_byte(*ptr++);
+		}
+		for(ptr = params->tx_buf, count = params->tx_count; !status && count; count--) {
+			status = write_byte(*ptr++);
+		}
+		if(status || !params->rx_count) {
+			goto stop;
+		}
+		status = send_start(1);	/* Repeated START for read phase */
+		if(status) {
+			goto release;
+		}
+	}
+
+	/* Read phase: SLA+R, then rx data with NACK on last byte */
+	status = write_byte((params->slave_addr << 1) | 1);
+	for(count = params->rx_count; !status && count; count--) {
+		status = read_byte(&params->rx_buf[params->rx_count - count], (count > 1));
+	}
+
+stop:
+	/* No STOP after losing the bus or when SCL is held low */
+	if((status != TWI_STATUS_ARBLOST) && (status != TWI_STATUS_TIMEOUT)) {
+		if(send_stop() == TWI_STATUS_DONE) {
+			return status;
+		}
+		status = TWI_STATUS_TIMEOUT;
+	}
+
+release:
+	SDA_RELEASE();
+	SCL_RELEASE();
+	return status;
+}
+
+
+uint8_t SoftTWI_Device_Present(uint8_t slave_addr)
+{
+	twi_params_t params = {0};
+
+	params.slave_addr = slave_addr;
+	return (SoftTWI_Master_Transfer(&params) == TWI_STATUS_DONE);
+}
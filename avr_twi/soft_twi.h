@@ -0,0 +1,46 @@
+/*
+ *	soft_twi.h
+ *
+ *	Bit-banged I2C master for AVR, using any two GPIO pins
+ *	It uses the same twi_params_t/twi_status_t as the hardware TWI driver (avr_twi), so device
+ *	drivers can be used on either bus.
+ *
+ *	Pins are defined in soft_twi_config.h, which should be present in the project directory:
+ *		SOFT_TWI_PORT, SOFT_TWI_DDR, SOFT_TWI_PIN - Port registers of SCL and SDA pins
+ *		SOFT_TWI_SCL_BIT, SOFT_TWI_SDA_BIT - Pin numbers of SCL and SDA
+ *		SOFT_TWI_FREQ - (optional) Maximum SCL frequency in Hz, default 400kHz. The bit delays meet the
+ *						I2C timing of this frequency and the loop code adds to them: the real rate is lower.
+ *	Both lines need external pull-up resistors.
+ *
+ *	There is a single bit-banged bus, on the pins of soft_twi_config.h. It is selected at build time for
+ *	each driver source file with TWI_BUS_SOFT (see avr_twi.h).
+ */
+
+#ifndef SOFT_TWI_H
+#define SOFT_TWI_H
+
+#include <stdint.h>
+#include "avr_twi.h"
+
+
+/* Initialize the GPIO pins of the bus (both lines released) */
+void SoftTWI_Init(void);
+
+
+/* Performs a transfer on the bit-banged bus, based on parameters passed (see TWI_Master_Transfer)
+ *	Clock stretching by slaves is supported, upto TWI_TIMEOUT_US.
+ *
+ *		Returns: TWI_STATUS_DONE - Success
+ *				 TWI_STATUS_NOACK - Slave did not acknowledge
+ *				 TWI_STATUS_ARBLOST - SDA was held low by another device while sending a '1' or a START
+ *				 TWI_STATUS_BUSERROR - Bus not idle (SDA or SCL low) before the START, nothing was sent
+ *				 TWI_STATUS_TIMEOUT - Slave stretched the clock for too long
+ */
+twi_status_t SoftTWI_Master_Transfer(twi_params_t *params);
+
+
+/* Probes slave_addr with SLA+W. Returns 1 if the device acknowledged (no scan cache on this bus) */
+uint8_t SoftTWI_Device_Present(uint8_t slave_addr);
+
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ *	twi_sampler.c
+ *
+ *	Periodic TWI sampling engine
+ *
+ *	Transfers are started from the tick interrupt and chained from the TWI interrupt (completion callback),
+ *	so sample timing does not depend on the main loop. A blocking TWI_Master_Transfer() from the main
+ *	loop waits for a sampler transfer in progress, and vice versa a due sample waits for the next tick.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "twi_sampler.h"
+
+
+#if TWI_SAMPLER_USE_TIMER2
+/* Timer2 prescaler for the tick rate */
+#if (F_CPU / 64 / TWI_SAMPLER_TICK_HZ) <= 256
+	#define SAMPLER_PRESCALE		64
+	#define SAMPLER_CS_BITS			(1 << CS22)
+#elif (F_CPU / 128 / TWI_SAMPLER_TICK_HZ) <= 256
+	#define SAMPLER_PRESCALE		128
+	#define SAMPLER_CS_BITS			((1 << CS22)|(1 << CS20))
+#elif (F_CPU / 1024 / TWI_SAMPLER_TICK_HZ) <= 256
+	#define SAMPLER_PRESCALE		1024
+	#define SAMPLER_CS_BITS			((1 << CS22)|(1 << CS21)|(1 << CS20))
+#else
+	#error "TWI_SAMPLER_TICK_HZ too low for Timer2"
+#endif
+#define SAMPLER_OCR					((F_CPU / SAMPLER_PRESCALE / TWI_SAMPLER_TICK_HZ) - 1)
+#endif
+
+
+static twi_sample_t		*_samples;		/* List of registered samples */
+static twi_sample_t		*_active;		/* Sample with transfer in progress */
+
+
+static void sampler_kick(void);
+
+
+/* End of sample transfer (TWI interrupt) */
+static void sampler_done(twi_status_t status)
+{
+	twi_sample_t *sample = _active;
+
+	if(status == TWI_STATUS_DONE) {
+		sample->ready ^= 1;		/* Slot is written before ready and seq are updated */
+		if(!++sample->seq) {
+			sample->seq = 1;	/* 0 means no sample */
+		}
+	}
+	sample->status = status;
+	_active = 0;
+	sampler_kick();
+}
+
+
+/* Starts the transfer of the first due sample, if the bus is free (interrupt context) */
+static void sampler_kick(void)
+{
+	twi_sample_t *sample;
+
+	if(_active) {
+		return;
+	}
+	for(sample = _samples; sample; sample = sample->next) {
+		if(sample->pending) {
+			/* Read into the slot not holding the latest sample */
+			sample->params.rx_buf = sample->slots + ((sample->ready ^ 1) * sample->params.rx_count);
+			_active = sample;
+			if(TWI_Master_Transfer_Async(&sample->params, sampler_done)) {
+				_active = 0;	/* Bus busy, retried on next tick */
+			}
+			else {
+				sample->pending = 0;
+			}
+			return;
+		}
+	}
+}
+
+
+void TWI_Sampler_Tick(void)
+{
+	twi_sample_t *sample;
+
+	for(sample = _samples; sample; sample = sample->next) {
+		if(++sample->ticks >= sample->period) {
+			sample->ticks = 0;
+			if(sample->pending) {
+				sample->overruns++;
+			}
+			sample->pending = 1;
+		}
+	}
+	sampler_kick();
+}
+
+
+void TWI_Sampler_Add(twi_sample_t *sample)
+{
+	uint8_t sreg = SREG;
+
+	sample->ticks = 0;
+	sample->pending = 0;
+	sample->ready = 1;	/* First sample goes into slot 0 */
+	sample->seq = 0;
+	sample->status = TWI_STATUS_BUSY;
+	sample->overruns = 0;
+	cli();
+	sample->next = _samples;
+	_samples = sample;
+	SREG = sreg;
+}
+
+
+void TWI_Sampler_Start(void)
+{
+	TWI_Init();
+#if TWI_SAMPLER_USE_TIMER2
+#if defined(TCCR2A)
+	TCCR2A = (1 << WGM21);		/* CTC mode */
+	TCCR2B = SAMPLER_CS_BITS;
+	OCR2A = SAMPLER_OCR;
+	TCNT2 = 0;
+	TIMSK2 |= (1 << OCIE2A);
+#else
+	TCCR2 = (1 << WGM21)|SAMPLER_CS_BITS;
+	OCR2 = SAMPLER_OCR;
+	TCNT2 = 0;
+	TIMSK |= (1 << OCIE2);
+#endif
+#endif
+}
+
+
+void TWI_Sampler_Stop(void)
+{
+#if TWI_SAMPLER_USE_TIMER2
+#if defined(TCCR2A)
+	TIMSK2 &= ~(1 << OCIE2A);
+	TCCR2B = 0;
+#else
+	TIMSK &= ~(1 << OCIE2);
+	TCCR2 = 0;
+#endif
+#endif
+}
+
+
+twi_status_t TWI_Sampler_Read(twi_sample_t *sample, uint8_t *buf, uint8_t *seq)
+{
+	const uint8_t *src;
+	uint8_t count;
+	uint8_t s;
+
+	/* Retry if a new sample completed while copying (the slot being copied could be re-used after that) */
+	do {
+		s = sample->seq;
+		src = sample->slots + (sample->ready * sample->params.rx_count);
+		for(count = 0; count < sample->params.rx_count; count++) {
+			buf[count] = src[count];
+		}
+	} while(s != sample->seq);
+
+	*seq = s;
+	return sample->status;
+}
+
+
+#if TWI_SAMPLER_USE_TIMER2
+#if defined(TIMER2_COMPA_vect)
+ISR(TIMER2_COMPA_vect)
+#else
+ISR(TIMER2_COMP_vect)
+#endif
+{
+	TWI_Sampler_Tick();
+}
+#endif
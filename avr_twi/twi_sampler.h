@@ -0,0 +1,82 @@
+/*
+ *	twi_sampler.h
+ *
+ *	Periodic TWI sampling engine
+ *
+ *	A timer interrupt starts pre-registered TWI read transfers at fixed periods, in the background.
+ *	Each result is stored in one of two slots of the sample, alternately, with a sequence number.
+ *	The application picks up the latest complete sample at any time, without waiting for the bus.
+ *
+ *	Usage (MPU6050 at 100Hz with 1kHz tick):
+ *		static uint8_t mpu_slots[2 * 14];
+ *		static twi_sample_t mpu_sample = { .params = { .slave_addr = 0x68, .tx_prefix = {0x3B},
+ *											.tx_prefix_count = 1, .rx_count = 14 },
+ *										   .slots = mpu_slots, .period = 10 };
+ *		TWI_Sampler_Add(&mpu_sample);
+ *		TWI_Sampler_Start();
+ *		...
+ *		if(TWI_Sampler_Read(&mpu_sample, buf, &seq) == TWI_STATUS_DONE && seq != last_seq) { ... }
+ */
+
+#ifndef TWI_SAMPLER_H
+#define TWI_SAMPLER_H
+
+#include <stdint.h>
+#include "avr_twi.h"
+
+
+/* Sampler tick rate (Hz). Sample periods are given in ticks */
+#ifndef TWI_SAMPLER_TICK_HZ
+#define TWI_SAMPLER_TICK_HZ			1000
+#endif
+
+/* Define to 0 to drive the sampler from another timer interrupt, by calling TWI_Sampler_Tick() */
+#ifndef TWI_SAMPLER_USE_TIMER2
+#define TWI_SAMPLER_USE_TIMER2		1
+#endif
+
+
+/* A periodic read transfer */
+typedef struct twi_sample {
+	twi_params_t		params;		/* Transfer to perform: slave_addr, tx_prefix/tx_buf and rx_count (rx_buf is set by the engine) */
+	uint8_t				*slots;		/* Buffer of (2 * rx_count) bytes for the two result slots */
+	uint8_t				period;		/* Sampling period in ticks */
+
+	/* Used by the engine */
+	uint8_t				ticks;		/* Ticks since last sample */
+	uint8_t				pending;	/* Sample is due, waiting for the bus */
+	volatile uint8_t	ready;		/* Slot (0/1) containing the latest sample */
+	volatile uint8_t	seq;		/* Incremented for every new sample */
+	volatile twi_status_t status;	/* Status of the latest transfer */
+	uint8_t				overruns;	/* Samples skipped because the previous one was still pending */
+	struct twi_sample	*next;
+} twi_sample_t;
+
+
+/* Registers a sample to be read periodically. Can be called before or after TWI_Sampler_Start() */
+void TWI_Sampler_Add(twi_sample_t *sample);
+
+
+/* Initializes the TWI bus and starts the sampler tick (Timer2 in CTC mode, unless TWI_SAMPLER_USE_TIMER2 = 0) */
+void TWI_Sampler_Start(void);
+
+
+/* Stops the sampler tick. A transfer in progress is completed */
+void TWI_Sampler_Stop(void);
+
+
+/* Advances the sampler by one tick and starts due transfers. To be called from a timer interrupt,
+ * only if TWI_SAMPLER_USE_TIMER2 = 0
+ */
+void TWI_Sampler_Tick(void);
+
+
+/* Copies the latest complete sample (rx_count bytes) into buf, without blocking
+ *	seq - Location to return the sequence number of the copied sample (0 if no sample yet)
+ *
+ *	Returns: Status of the latest transfer. When it is not TWI_STATUS_DONE, buf holds the last good sample.
+ */
+twi_status_t TWI_Sampler_Read(twi_sample_t *sample, uint8_t *buf, uint8_t *seq);
+
+
+#endif
@@ -72,6 +72,11 @@ typedef struct _ds3231_alarm {
 
 /*********** FUNCTIONS ************/
 
+/* Initializes the RTC: Alarm 1 masked, flags cleared, 32kHz output disabled
+ * Returns: 0 - success
+ *			TWI_STATUS_NOACK - RTC not present on the bus (init sequence not sent)
+ *			other - twi_status_t of the failed transfer
+ */
 uint8_t ds3231_init(void);
 uint8_t ds3231_set_time(ds3231_time_t *time);
 uint8_t ds3231_read_time(ds3231_time_t *time);
@@ -23,6 +23,10 @@ uint8_t hmc5883_init(uint8_t config, uint8_t mode, uint8_t gain)
 	
 	/* Initialize AVR TWI bus */
 	TWI_Init();
+	/* Skip init sequence if device is missing */
+	if(!TWI_Device_Present(HMC5883_SLA_ADDR)) {
+		return TWI_STATUS_NOACK;
+	}
 	
 	params.slave_addr = HMC5883_SLA_ADDR;
 	/* Disable sleep mode */
@@ -42,11 +46,10 @@ uint8_t hmc5883_init(uint8_t config, uint8_t mode, uint8_t gain)
 uint8_t hmc5883_get_data(uint8_t *buf)
 {
 	twi_params_t  	params = {0};
-	uint8_t 		tx_data = 0x3;	/* Data registers start at 0x3 */
 	
 	params.slave_addr = HMC5883_SLA_ADDR;
-	params.tx_buf = &tx_data;
-	params.tx_count = 1;
+	params.tx_prefix[0] = 0x3;	/* Data registers start at 0x3 */
+	params.tx_prefix_count = 1;
 	params.rx_buf = buf;
 	params.rx_count = 6;	/* Read all 6 registers(8-bit) */
 	
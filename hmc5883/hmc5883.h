@@ -57,6 +57,7 @@
  * @param mode : Operating mode (continuous or single)
  * @param gain : Gain setting
  * @return 0 - Success
+ *         TWI_STATUS_NOACK - Device not present on the bus (init sequence not sent)
  *         1 - Error
  */
 uint8_t hmc5883_init(uint8_t config, uint8_t mode, uint8_t gain);
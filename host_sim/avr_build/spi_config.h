@@ -0,0 +1,26 @@
+/*
+ *	spi_config.h for the AVR builds of make avr (avr-gcc compile checks)
+ *
+ *	SPI_BACKEND is given on the command line. Pins of the SPI module (ATmega), or of the USI (ATtiny25/45/85)
+ */
+
+#ifndef SPI_CONFIG_H
+#define SPI_CONFIG_H
+
+#define SPI_PORT		PORTB
+#define SPI_DDR			DDRB
+#define SPI_PIN			PINB
+
+#if defined(__AVR_ATtiny25__) || defined(__AVR_ATtiny45__) || defined(__AVR_ATtiny85__)
+#define MOSI_BIT		1
+#define MISO_BIT		0
+#define SCK_BIT			2
+#define SS_BIT			3
+#else
+#define MOSI_BIT		3
+#define MISO_BIT		4
+#define SCK_BIT			5
+#define SS_BIT			2
+#endif
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ *	avr/interrupt.h for host simulation
+ *
+ *	Interrupt vectors are plain functions, called by the simulated peripherals while the I bit of SREG is set.
+ */
+
+#ifndef HOST_SIM_AVR_INTERRUPT_H
+#define HOST_SIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define TWI_vect			TWI_vect
+#define SPI_STC_vect		SPI_STC_vect
+#define INT0_vect			INT0_vect
+#define INT1_vect			INT1_vect
+#define TIMER2_COMPA_vect	TIMER2_COMPA_vect
+
+#define ISR(vector, ...)	void vector(void); void vector(void)
+
+#define sei()				(SREG |= 0x80)
+#define cli()				(SREG &= ~0x80)
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ *	avr/io.h for host simulation
+ *
+ *	I/O registers of ATmega328P as plain variables (defined in sim.c). Peripherals modelled by the
+ *	simulator (see twi_sim.h) react to register writes when simulated time advances.
+ */
+
+#ifndef HOST_SIM_AVR_IO_H
+#define HOST_SIM_AVR_IO_H
+
+#include <stdint.h>
+
+#ifndef __AVR_ATmega328P__
+#define __AVR_ATmega328P__
+#endif
+
+#define _BV(bit)		(1 << (bit))
+
+#define SIM_REG8(name)	extern volatile uint8_t name;
+#define SIM_REG16(name)	extern volatile uint16_t name;
+
+SIM_REG8(SREG)
+SIM_REG8(PINB)	SIM_REG8(DDRB)	SIM_REG8(PORTB)
+SIM_REG8(PINC)	SIM_REG8(DDRC)	SIM_REG8(PORTC)
+SIM_REG8(PIND)	SIM_REG8(DDRD)	SIM_REG8(PORTD)
+SIM_REG8(EICRA)	SIM_REG8(EIMSK)	SIM_REG8(EIFR)	SIM_REG8(PCICR)
+SIM_REG8(SMCR)	SIM_REG8(MCUCR)	SIM_REG8(MCUSR)	SIM_REG8(PRR)
+SIM_REG8(TCCR0A)	SIM_REG8(TCCR0B)	SIM_REG8(TCNT0)	SIM_REG8(OCR0A)	SIM_REG8(OCR0B)	SIM_REG8(TIMSK0)	SIM_REG8(TIFR0)
+SIM_REG8(TCCR1A)	SIM_REG8(TCCR1B)	SIM_REG8(TCCR1C)	SIM_REG16(TCNT1)	SIM_REG16(OCR1A)	SIM_REG16(OCR1B)	SIM_REG8(TIMSK1)	SIM_REG8(TIFR1)
+SIM_REG8(TCCR2A)	SIM_REG8(TCCR2B)	SIM_REG8(TCNT2)	SIM_REG8(OCR2A)	SIM_REG8(OCR2B)	SIM_REG8(TIMSK2)	SIM_REG8(TIFR2)
+SIM_REG8(SPCR)	SIM_REG8(SPSR)	SIM_REG8(SPDR)
+SIM_REG8(TWBR)	SIM_REG8(TWSR)	SIM_REG8(TWAR)	SIM_REG8(TWDR)	SIM_REG8(TWCR)	SIM_REG8(TWAMR)
+SIM_REG8(UCSR0A)	SIM_REG8(UCSR0B)	SIM_REG8(UCSR0C)	SIM_REG16(UBRR0)	SIM_REG8(UDR0)
+
+/* Registers tested with #if defined by the drivers, as avr-libc macros */
+#define EICRA	EICRA
+#define EIMSK	EIMSK
+
+/* Port pins */
+#define PB0		0
+#define PB1		1
+#define PB2		2
+#define PB3		3
+#define PB4		4
+#define PB5		5
+#define PB6		6
+#define PB7		7
+#define PC0		0
+#define PC1		1
+#define PC2		2
+#define PC3		3
+#define PC4		4
+#define PC5		5
+#define PC6		6
+#define PD0		0
+#define PD1		1
+#define PD2		2
+#define PD3		3
+#define PD4		4
+#define PD5		5
+#define PD6		6
+#define PD7		7
+
+/* External interrupts */
+#define ISC00	0
+#define ISC01	1
+#define ISC10	2
+#define ISC11	3
+#define INT0	0
+#define INT1	1
+#define INTF0	0
+#define INTF1	1
+
+/* Sleep mode */
+#define SE		0
+#define SM0		1
+#define SM1		2
+#define SM2		3
+
+/* Timers */
+#define WGM00	0
+#define WGM01	1
+#define WGM02	3
+#define CS00	0
+#define CS01	1
+#define CS02	2
+#define OCIE0A	1
+#define OCF0A	1
+#define WGM10	0
+#define WGM11	1
+#define WGM12	3
+#define WGM13	4
+#define CS10	0
+#define CS11	1
+#define CS12	2
+#define OCIE1A	1
+#define OCF1A	1
+#define WGM20	0
+#define WGM21	1
+#define WGM22	3
+#define CS20	0
+#define CS21	1
+#define CS22	2
+#define OCIE2A	1
+#define OCF2A	1
+
+/* SPI */
+#define SPR0	0
+#define SPR1	1
+#define CPHA	2
+#define CPOL	3
+#define MSTR	4
+#define DORD	5
+#define SPE		6
+#define SPIE	7
+#define SPI2X	0
+#define WCOL	6
+#define SPIF	7
+
+/* TWI */
+#define TWIE	0
+#define TWEN	2
+#define TWWC	3
+#define TWSTO	4
+#define TWSTA	5
+#define TWEA	6
+#define TWINT	7
+#define TWPS0	0
+#define TWPS1	1
+#define TWGCE	0
+
+/* USART0 */
+#define MPCM0	0
+#define U2X0	1
+#define UDRE0	5
+#define TXC0	6
+#define RXC0	7
+#define TXB80	0
+#define RXB80	1
+#define UCSZ02	2
+#define TXEN0	3
+#define RXEN0	4
+#define UDRIE0	5
+#define TXCIE0	6
+#define RXCIE0	7
+#define UCPOL0	0
+#define UCSZ00	1
+#define UCPHA0	1
+#define UCSZ01	2
+#define UDORD0	2
+#define UMSEL00	6
+#define UMSEL01	7
+
+#endif
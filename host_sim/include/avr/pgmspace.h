@@ -0,0 +1,15 @@
+/*
+ *	avr/pgmspace.h for host simulation : program memory is ordinary memory
+ */
+
+#ifndef HOST_SIM_AVR_PGMSPACE_H
+#define HOST_SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s)				(s)
+#define pgm_read_byte(addr)	(*(const uint8_t *)(addr))
+#define pgm_read_word(addr)	(*(const uint16_t *)(addr))
+
+#endif
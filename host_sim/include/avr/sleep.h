@@ -0,0 +1,22 @@
+/*
+ *	avr/sleep.h for host simulation : sleep advances the simulated time up to the next peripheral event
+ */
+
+#ifndef HOST_SIM_AVR_SLEEP_H
+#define HOST_SIM_AVR_SLEEP_H
+
+#include <avr/io.h>
+#include "sim.h"
+
+#define SLEEP_MODE_IDLE			0
+#define SLEEP_MODE_ADC			_BV(SM0)
+#define SLEEP_MODE_PWR_DOWN		_BV(SM1)
+#define SLEEP_MODE_PWR_SAVE		(_BV(SM0)|_BV(SM1))
+#define SLEEP_MODE_STANDBY		(_BV(SM1)|_BV(SM2))
+
+#define set_sleep_mode(mode)	(SMCR = (SMCR & ~(_BV(SM0)|_BV(SM1)|_BV(SM2))) | (mode))
+#define sleep_enable()			(SMCR |= _BV(SE))
+#define sleep_disable()			(SMCR &= ~_BV(SE))
+#define sleep_cpu()				sim_sleep()
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ *	util/delay.h for host simulation : delays advance the simulated time
+ */
+
+#ifndef HOST_SIM_UTIL_DELAY_H
+#define HOST_SIM_UTIL_DELAY_H
+
+#include "sim.h"
+
+static inline void _delay_us(double us)
+{
+	sim_advance_ns((uint64_t)(us * 1000));
+}
+
+static inline void _delay_ms(double ms)
+{
+	sim_advance_ns((uint64_t)(ms * 1000000));
+}
+
+#endif
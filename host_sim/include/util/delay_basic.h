@@ -0,0 +1,23 @@
+/*
+ *	util/delay_basic.h for host simulation : delay loops advance the simulated time by their cycle count
+ */
+
+#ifndef HOST_SIM_UTIL_DELAY_BASIC_H
+#define HOST_SIM_UTIL_DELAY_BASIC_H
+
+#include <stdint.h>
+#include "sim.h"
+
+/* 3 cycles per count, 256 counts for 0 */
+static inline void _delay_loop_1(uint8_t count)
+{
+	sim_advance_ns((3ULL * (count ? count : 256) * 1000000000ULL) / F_CPU);
+}
+
+/* 4 cycles per count, 65536 counts for 0 */
+static inline void _delay_loop_2(uint16_t count)
+{
+	sim_advance_ns((4ULL * (count ? count : 65536) * 1000000000ULL) / F_CPU);
+}
+
+#endif
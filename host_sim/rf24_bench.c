@@ -0,0 +1,111 @@
+/*
+ *	rf24_bench.c
+ *
+ *	Throughput of the rf24_lib transmit functions on the simulated nRF24L01+ (make bench)
+ *
+ *	Sends the same packets with each API and prints the simulated time, payload rate, SPI traffic per packet
+ *	and the longest continuous time the radio spent in TX mode.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/io.h>
+#include "sim.h"
+#include "spi_sim.h"
+#include "spi_sim_devices.h"
+#include "rf24.h"
+#include "rf24_config.h"
+
+#define BENCH_PACKETS		500
+#define BENCH_LENGTH		32
+
+enum {
+	BENCH_TRANSMIT,
+	BENCH_TRANSMIT_NOACK,
+	BENCH_QUEUE,
+	BENCH_STREAM,
+	BENCH_STREAM_NOACK
+};
+
+static const char *_names[] = {
+	"rf24_transmit_packet",
+	"rf24_transmit_packet_noack",
+	"rf24_queue_packet",
+	"rf24_stream_write (ACK)",
+	"rf24_stream_write (no ACK)"
+};
+
+static spi_sim_nrf24_t	_radio;
+static uint8_t			_packet[BENCH_LENGTH];
+
+
+static void bench_send(uint8_t api)
+{
+	uint16_t i;
+
+	switch(api) {
+	case BENCH_TRANSMIT:
+		for(i = 0; i < BENCH_PACKETS; i++) {
+			rf24_transmit_packet(_packet, BENCH_LENGTH);
+		}
+		break;
+	case BENCH_TRANSMIT_NOACK:
+		for(i = 0; i < BENCH_PACKETS; i++) {
+			rf24_transmit_packet_noack(_packet, BENCH_LENGTH);
+		}
+		break;
+	case BENCH_QUEUE:
+		for(i = 0; i < BENCH_PACKETS; ) {
+			if(!rf24_queue_packet(_packet, BENCH_LENGTH, RF24_TX_PLOAD)) {
+				i++;
+			}
+		}
+		while(rf24_tx_poll(0))
+			;
+		break;
+	default:
+		rf24_stream_begin((api == BENCH_STREAM) ? RF24_TX_PLOAD : RF24_TX_PLOAD_NOACK);
+		for(i = 0; i < BENCH_PACKETS; ) {
+			if(!rf24_stream_write(_packet, BENCH_LENGTH)) {
+				i++;
+			}
+		}
+		rf24_stream_end(0);
+		break;
+	}
+}
+
+
+int main(void)
+{
+	static const uint8_t address[] = CONFIG_RF24_ADDRESS;
+	spi_sim_stats_t spi;
+	uint64_t start, ns;
+	uint32_t sent;
+	uint8_t api;
+
+	sim_reset();
+	spi_sim_init();
+	spi_sim_nrf24_init(&_radio, &PORTB, 2, &PORTB, 1);
+	if(rf24_init(RF24_MODE_PTX, address)) {
+		printf("rf24_init failed\n");
+		return 1;
+	}
+	printf("%u packets of %u bytes, SCK %lu Hz\n\n", BENCH_PACKETS, BENCH_LENGTH, (unsigned long)spi_sim_sck_hz());
+	printf("%-28s %9s %9s %9s %10s %10s %9s\n", "API", "time ms", "pkt/s", "kbit/s", "SPI trans", "SPI bytes", "TX max ms");
+	for(api = BENCH_TRANSMIT; api <= BENCH_STREAM_NOACK; api++) {
+		spi_sim_stats_reset();
+		_radio.packets_tx = 0;
+		_radio.tx_mode_max_ns = 0;
+		start = sim_now_ns();
+		bench_send(api);
+		ns = sim_now_ns() - start;
+		spi_sim_stats_get(&spi);
+		sent = _radio.packets_tx;
+		printf("%-28s %9.2f %9.0f %9.1f %10.1f %10.1f %9.2f%s\n", _names[api], ns / 1e6, sent * 1e9 / ns,
+			   sent * BENCH_LENGTH * 8 * 1e6 / ns, (double)spi.transactions / BENCH_PACKETS,
+			   (double)spi.bytes / BENCH_PACKETS, _radio.tx_mode_max_ns / 1e6,
+			   (sent != BENCH_PACKETS) ? "  (packets lost)" : "");
+	}
+	return 0;
+}
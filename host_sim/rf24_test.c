@@ -0,0 +1,568 @@
+/*
+ *	rf24_test.c
+ *
+ *	Tests of rf24_lib.c on the simulated nRF24L01+ (make test)
+ *
+ *	Built three times: rf24_test with the rf24_config.h macros, rf24_test_rt with CONFIG_RF24_RUNTIME_CONFIG
+ *	(adds the runtime configuration test), rf24_test_irq in interrupt mode with an Rx queue (adds the IRQ
+ *	tests; the radio IRQ pin drives INT1, see sim.h). Each test starts with a radio at power-on reset state,
+ *	initialized by rf24_init(). The counters of rf24_tx_poll() are not reset by rf24_init(): tests compare them with the
+ *	values before sending. Failed checks are printed, and the program exits with 1 if any check failed.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "sim.h"
+#include "spi_sim.h"
+#include "spi_sim_devices.h"
+#include "rf24_config.h"
+#include "rf24.h"
+#include "rf24_reg.h"
+#include "avr_spi.h"
+
+#define CHECK(cond)		do { \
+							if(!(cond)) { \
+								printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+								_failures++; \
+							} \
+						} while(0)
+
+#define CE_IS_HIGH()	((PORTB & _BV(1)) != 0)
+
+static unsigned				_failures;
+
+static spi_sim_nrf24_t		_radio;
+static const uint8_t		_address[5] = { 0x11, 0x22, 0x33, 0x44, 0x55 };
+static uint8_t				_packet[32];
+
+#if !CONFIG_RF24_POLLED_MODE
+void INT1_vect(void);
+#endif
+
+
+/* Radio at power-on reset state */
+static void radio_reset(void)
+{
+	spi_sim_nrf24_init(&_radio, &PORTB, 2, &PORTB, 1);
+	_radio.irq_port = &PIND;	/* INT1 */
+	_radio.irq_mask = _BV(PD3);
+}
+
+
+/* Radio at power-on reset state, simulated time 0 */
+static void test_setup(void)
+{
+	sim_reset();
+	spi_sim_init();
+	radio_reset();
+	memset(_packet, 0, sizeof(_packet));
+	sei();
+}
+
+
+static void test_transmit(void)
+{
+	CHECK(rf24_init(RF24_MODE_PTX, _address) == 0);
+	CHECK(memcmp(_radio.tx_addr, _address, 5) == 0);
+	CHECK(memcmp(_radio.rx_addr_p0, _address, 5) == 0);	/* ACKs on Pipe 0 */
+	CHECK((_radio.regs[SETUP_RETR] & 0x0F) == CONFIG_RF24_TX_RETRANSMITS);
+	CHECK(_radio.regs[RF_CH] == CONFIG_RF24_RF_CHANNEL);
+
+	CHECK(rf24_transmit_packet(_packet, 32) == 0);
+	CHECK(_radio.packets_tx == 1);
+	CHECK(!CE_IS_HIGH());
+
+	/* No ACK: all retransmits made, packet dropped */
+	_radio.link = 0;
+	CHECK(rf24_transmit_packet(_packet, 32) == 1);
+	CHECK(_radio.max_rt == 1);
+	CHECK(_radio.attempts == 1 + 1 + CONFIG_RF24_TX_RETRANSMITS);
+	CHECK((rf24_get_observe_tx() & 0x0F) == CONFIG_RF24_TX_RETRANSMITS);
+
+	/* Without ACK the packet is sent once, whether it arrives or not */
+	CHECK(rf24_transmit_packet_noack(_packet, 32) == 0);
+	_radio.link = 1;
+	CHECK(rf24_transmit_packet_noack(_packet, 8) == 0);
+	CHECK(_radio.packets_tx == 2);
+}
+
+
+/* Brown-out of the radio (powered down behind the driver's back): no end of transmission */
+static void test_timeout(void)
+{
+	rf24_tx_counters_t counters;
+	uint16_t failed;
+
+	CHECK(rf24_init(RF24_MODE_PTX, _address) == 0);
+	_radio.regs[CONFIG] &= ~CONFIG_PWR_UP;
+	CHECK(rf24_transmit_packet(_packet, 8) == 3);
+	CHECK(sim_now_ns() < 200000000ULL);
+	CHECK(_radio.regs[CONFIG] & CONFIG_PWR_UP);		/* Configured again by rf24_recover() */
+	CHECK(!CE_IS_HIGH());
+	CHECK(rf24_transmit_packet(_packet, 8) == 0);
+	CHECK(_radio.packets_tx == 1);
+
+	/* Packets in flight of a stream are counted as failed */
+	rf24_tx_poll(&counters);
+	failed = counters.failed;
+	rf24_stream_begin(RF24_TX_PLOAD_NOACK);
+	CHECK(rf24_stream_write(_packet, 8) == 0);
+	_radio.regs[CONFIG] &= ~CONFIG_PWR_UP;
+	CHECK(rf24_stream_write(_packet, 8) == 0);
+	CHECK(rf24_stream_end(&counters) == 3);
+	CHECK(counters.in_flight == 0);
+	CHECK(counters.failed == failed + 2);
+	CHECK(!CE_IS_HIGH());
+
+	/* Recovered by hand */
+	_radio.regs[CONFIG] &= ~CONFIG_PWR_UP;
+	CHECK(rf24_recover() == 0);
+	CHECK(_radio.regs[CONFIG] & CONFIG_PWR_UP);
+	CHECK(rf24_transmit_packet(_packet, 8) == 0);
+}
+
+
+static void test_queue(void)
+{
+	rf24_tx_counters_t counters;
+	uint16_t sent, failed;
+	uint8_t i;
+
+	CHECK(rf24_init(RF24_MODE_PTX, _address) == 0);
+	rf24_tx_poll(&counters);
+	sent = counters.sent;
+	failed = counters.failed;
+
+	for(i = 0; i < 10; ) {
+		if(!rf24_queue_packet(_packet, 32, RF24_TX_PLOAD)) {
+			i++;
+		}
+		CHECK(rf24_transmit_packet(_packet, 32) == 2);	/* Not while packets are in flight */
+	}
+	while(rf24_tx_poll(&counters))
+		;
+	CHECK(counters.sent == sent + 10);
+	CHECK(counters.failed == failed);
+	CHECK(_radio.packets_tx == 10);
+	CHECK(!CE_IS_HIGH());
+
+	/* MAX_RT flushes the Tx FIFO: the failed packet and the ones queued after it */
+	_radio.link = 0;
+	for(i = 0; i < 3; i++) {
+		CHECK(rf24_queue_packet(_packet, 32, RF24_TX_PLOAD) == 0);
+	}
+	while(rf24_tx_poll(&counters))
+		;
+	CHECK(counters.sent == sent + 10);
+	CHECK(counters.failed == failed + 3);
+	CHECK(_radio.max_rt == 1);
+	CHECK(_radio.tx_count == 0);	/* Not sent again before the flush */
+	CHECK(!CE_IS_HIGH());
+
+	_radio.link = 1;
+	CHECK(rf24_transmit_packet(_packet, 32) == 0);
+
+	/* No limit on the time in TX mode without ACKs: use a stream */
+	CHECK(rf24_queue_packet(_packet, 32, RF24_TX_PLOAD_NOACK) == 1);
+	CHECK(rf24_tx_poll(0) == 0);
+}
+
+
+/* NOACK stream: CE held HIGH, but the radio never stays in TX mode for more than 4 ms */
+static void test_stream(void)
+{
+	rf24_tx_counters_t counters;
+	uint16_t i;
+
+	CHECK(rf24_init(RF24_MODE_PTX, _address) == 0);
+	rf24_stream_begin(RF24_TX_PLOAD_NOACK);
+	for(i = 0; i < 200; ) {
+		if(!rf24_stream_write(_packet, 32)) {
+			i++;
+		}
+	}
+	CHECK(rf24_stream_end(&counters) == 0);
+	CHECK(counters.in_flight == 0);
+	CHECK(_radio.packets_tx == 200);
+	CHECK(_radio.tx_mode_max_ns <= 4000000ULL);
+	CHECK(!CE_IS_HIGH());
+
+	rf24_stream_begin(RF24_TX_PLOAD);
+	for(i = 0; i < 20; ) {
+		if(!rf24_stream_write(_packet, 32)) {
+			i++;
+		}
+	}
+	CHECK(rf24_stream_end(&counters) == 0);
+	CHECK(_radio.packets_tx == 220);
+}
+
+
+/* Registers written are kept in shadow copies: no register read to switch modes or to power down */
+static void test_shadow(void)
+{
+	spi_sim_stats_t stats;
+	uint16_t i;
+
+	CHECK(rf24_init(RF24_MODE_PTX, _address) == 0);
+	spi_sim_trace_clear();
+	spi_sim_stats_reset();
+	for(i = 0; i < 10; i++) {
+		rf24_rx_mode();
+		CHECK((_radio.regs[CONFIG] & (CONFIG_PWR_UP | CONFIG_PRIM_RX)) == (CONFIG_PWR_UP | CONFIG_PRIM_RX));
+		CHECK(CE_IS_HIGH());
+		rf24_tx_mode();
+		CHECK((_radio.regs[CONFIG] & (CONFIG_PWR_UP | CONFIG_PRIM_RX)) == CONFIG_PWR_UP);
+		CHECK(!CE_IS_HIGH());
+	}
+	spi_sim_stats_get(&stats);
+	CHECK(stats.transactions == 10 * 5);	/* Rx: flush, clear flags, CONFIG. Tx: flush, CONFIG */
+	for(i = 0; i < spi_sim_trace_count(); i++) {
+		CHECK(spi_sim_trace_get(i)->mosi[0] >= WRITE_REG);
+	}
+
+	/* Shadow follows the writes */
+	rf24_powerdown();
+	CHECK(!(_radio.regs[CONFIG] & CONFIG_PWR_UP));
+	rf24_rx_mode();
+	CHECK((_radio.regs[CONFIG] & (CONFIG_PWR_UP | CONFIG_PRIM_RX)) == CONFIG_PRIM_RX);
+	rf24_powerup();
+	CHECK((_radio.regs[CONFIG] & (CONFIG_PWR_UP | CONFIG_PRIM_RX)) == (CONFIG_PWR_UP | CONFIG_PRIM_RX));
+
+	/* Cleared by rf24_init(), as the registers of a reset radio */
+	radio_reset();
+	CHECK(rf24_init(RF24_MODE_PTX, _address) == 0);
+	CHECK((_radio.regs[CONFIG] & (CONFIG_PWR_UP | CONFIG_PRIM_RX)) == CONFIG_PWR_UP);
+	CHECK(rf24_transmit_packet(_packet, 32) == 0);
+
+	/* Configured from the shadow: RF_CH read back only */
+	spi_sim_trace_clear();
+	CHECK(rf24_init(RF24_MODE_PTX, _address) == 0);
+	CHECK(_radio.regs[RF_SETUP] == (RF_DR_HIGH | (CONFIG_RF24_TX_PWR << 1) | RF_LNA));
+	for(i = 0; i < spi_sim_trace_count(); i++) {
+		CHECK((spi_sim_trace_get(i)->mosi[0] >= WRITE_REG) || (spi_sim_trace_get(i)->mosi[0] == RF_CH));
+	}
+}
+
+
+static void test_receive(void)
+{
+	uint8_t buf[32];
+	uint8_t len;
+	uint8_t i;
+
+	CHECK(rf24_init(RF24_MODE_PRX, _address) == 0);
+	CHECK(CE_IS_HIGH());
+	rf24_receive_packet(buf, &len);
+	CHECK(len == 0);
+
+	/* Rx FIFO full: the 4th packet is missed, the others come out in order */
+	for(i = 0; i < 4; i++) {
+		_packet[0] = i;
+		CHECK(spi_sim_nrf24_receive(&_radio, i & 1, _packet, 4 + i) == (i < 3));
+	}
+	_delay_us(100);		/* IRQ handled (interrupt mode) */
+	for(i = 0; i < 3; i++) {
+		CHECK(rf24_receive_packet(buf, &len) == (i & 1));
+		CHECK(len == 4 + i);
+		CHECK(buf[0] == i);
+	}
+	rf24_receive_packet(buf, &len);
+	CHECK(len == 0);
+}
+
+
+/* Multiceiver: pipes 1 - 5 with their own payload length and auto-ack */
+static void test_pipes(void)
+{
+	static const uint8_t lengths[6] = { 32, 5, 8, 5, 16, 20 };
+	static const uint8_t p1[5] = { 0x09, 0x09, 0x09, 0x09, 0x09 };
+	uint8_t buf[32];
+	uint8_t len;
+	uint8_t pipe;
+	uint8_t addr;
+
+	CHECK(rf24_init(RF24_MODE_PRX, _address) == 0);
+	CHECK(rf24_open_pipe(6, 0, 8, 1) == 1);
+	CHECK(rf24_open_pipe(RF24_PIPE2, 0, 0, 0) == 1);	/* Dynamic payload length needs autoack */
+	CHECK(rf24_open_pipe(RF24_PIPE2, 0, 33, 1) == 1);
+	CHECK(rf24_close_pipe(6) == 1);
+
+	CHECK(rf24_open_pipe(RF24_PIPE1, p1, 0, 1) == 0);
+	for(pipe = RF24_PIPE2; pipe <= RF24_PIPE5; pipe++) {
+		addr = 0x10 + pipe;
+		CHECK(rf24_open_pipe(pipe, &addr, (pipe == RF24_PIPE3) ? 0 : lengths[pipe], pipe != RF24_PIPE5) == 0);
+	}
+	CHECK(_radio.regs[EN_RXADDR] == 0x3F);
+	CHECK(_radio.regs[EN_AA] == 0x1F);
+	CHECK(_radio.regs[DYNPD] == 0x0B);
+	CHECK(_radio.regs[RX_PW_P2] == 8 && _radio.regs[RX_PW_P4] == 16 && _radio.regs[RX_PW_P5] == 20);
+	CHECK(memcmp(_radio.rx_addr_p1, p1, 5) == 0);
+	CHECK(_radio.regs[RX_ADDR_P2] == 0x12 && _radio.regs[RX_ADDR_P5] == 0x15);
+	CHECK(CE_IS_HIGH());	/* Back in Rx mode */
+
+	for(pipe = RF24_PIPE0; pipe <= RF24_PIPE5; pipe++) {
+		_packet[0] = pipe;
+		CHECK(spi_sim_nrf24_receive(&_radio, pipe, _packet, lengths[pipe]));
+		_delay_us(100);
+		CHECK(rf24_receive_packet(buf, &len) == pipe);
+		CHECK(len == lengths[pipe] && buf[0] == pipe);
+	}
+	CHECK(!spi_sim_nrf24_receive(&_radio, RF24_PIPE2, _packet, 5));	/* Not the static length */
+
+	CHECK(rf24_close_pipe(RF24_PIPE3) == 0);
+	CHECK(_radio.regs[EN_RXADDR] == 0x37);
+	CHECK(!spi_sim_nrf24_receive(&_radio, RF24_PIPE3, _packet, 5));
+}
+
+
+#if CONFIG_RF24_RUNTIME_CONFIG
+static void test_config(void)
+{
+	rf24_config_t saved;
+	rf24_config_t config;
+	uint8_t buf[32];
+	uint8_t len;
+
+	rf24_get_config(&saved);
+	CHECK(saved.channel == CONFIG_RF24_RF_CHANNEL && saved.rate == CONFIG_RF24_DATA_RATE);
+	CHECK(saved.addr_len == CONFIG_RF24_ADDR_LEN && saved.dynamic_payload == CONFIG_RF24_DYNAMIC_PL_ENABLED);
+	CHECK(rf24_init(RF24_MODE_PTX, _address) == 0);
+
+	config = saved;
+	config.channel = 126;
+	CHECK(rf24_apply_config(&config) == 2);
+	config.channel = 76;
+	config.ack_payload = 1;
+	config.dynamic_payload = 0;
+	CHECK(rf24_apply_config(&config) == 2);
+	config.ack_payload = 0;
+	config.dynamic_payload = 1;
+	config.addr_len = 3;
+	CHECK(rf24_apply_config(&config) == 2);		/* Address of rf24_init() is 5 bytes */
+	CHECK(_radio.regs[RF_CH] == CONFIG_RF24_RF_CHANNEL);	/* Not applied */
+	CHECK(_radio.regs[SETUP_AW] == CONFIG_RF24_ADDR_LEN - 2);
+
+	/* Applied to the initialized radio */
+	config = saved;
+	config.channel = 100;
+	config.power = RF24_PWR_M12DBM;
+	config.retransmits = 3;
+	config.dynamic_payload = 0;
+	config.payload_length = 16;
+	CHECK(rf24_apply_config(&config) == 0);
+	rf24_get_config(&config);
+	CHECK(config.channel == 100);
+	CHECK(_radio.regs[RF_CH] == 100);
+	CHECK((_radio.regs[RF_SETUP] & (RF_PWR1 | RF_PWR0)) == (RF24_PWR_M12DBM << 1));
+	CHECK((_radio.regs[SETUP_RETR] & 0x0F) == 3);
+	CHECK(_radio.regs[DYNPD] == 0 && _radio.regs[RX_PW_P0] == 16 && _radio.regs[RX_PW_P1] == 16);
+	CHECK(memcmp(_radio.tx_addr, _address, 5) == 0);
+	CHECK(rf24_open_pipe(RF24_PIPE2, 0, 0, 1) == 1);	/* No dynamic payload length */
+
+	_radio.link = 0;
+	CHECK(rf24_transmit_packet(_packet, 16) == 1);
+	CHECK(_radio.attempts == 1 + 3);
+	_radio.link = 1;
+	CHECK(rf24_transmit_packet(_packet, 16) == 0);
+
+	rf24_rx_mode();
+	_packet[0] = 42;
+	CHECK(spi_sim_nrf24_receive(&_radio, RF24_PIPE1, _packet, 16));
+	_delay_us(100);
+	CHECK(rf24_receive_packet(buf, &len) == RF24_PIPE1);
+	CHECK(len == 16 && buf[0] == 42);
+
+	/* Longer retransmit delay for the ACK at 250 kbps */
+	config.rate = RF24_RATE_250KBPS;
+	CHECK(rf24_apply_config(&config) == 0);
+	CHECK((_radio.regs[RF_SETUP] & (RF_DR_LOW | RF_DR_HIGH)) == RF_DR_LOW);
+	CHECK((_radio.regs[SETUP_RETR] >> 4) > 0);
+
+	CHECK(rf24_apply_config(&saved) == 0);
+	CHECK(_radio.regs[RF_CH] == CONFIG_RF24_RF_CHANNEL && _radio.regs[DYNPD] == 0x03);
+}
+#endif
+
+
+#if !CONFIG_RF24_POLLED_MODE
+/* Queued packets counted by the IRQ handler, which sets CE LOW once the Tx FIFO is empty */
+static void test_irq_queue(void)
+{
+	rf24_tx_counters_t counters;
+	uint16_t sent;
+	uint8_t i;
+
+	CHECK(rf24_init(RF24_MODE_PTX, _address) == 0);
+	rf24_tx_poll(&counters);
+	sent = counters.sent;
+
+	for(i = 0; i < 3; i++) {
+		CHECK(rf24_queue_packet(_packet, 32, RF24_TX_PLOAD) == 0);
+	}
+	_delay_ms(5);
+	CHECK(!CE_IS_HIGH());
+	CHECK(_radio.packets_tx == 3);
+	CHECK(rf24_tx_poll(&counters) == 0);
+	CHECK(counters.sent == sent + 3);
+
+	/* Interrupts disabled until all are sent: one IRQ for the 3 merged TX_DS, the rest seen in FIFO_STATUS */
+	cli();
+	for(i = 0; i < 3; i++) {
+		CHECK(rf24_queue_packet(_packet, 32, RF24_TX_PLOAD) == 0);
+	}
+	_delay_ms(5);
+	CHECK(_radio.packets_tx == 6);
+	CHECK(CE_IS_HIGH());
+	sei();
+	_delay_us(100);
+	CHECK(!CE_IS_HIGH());
+	CHECK(rf24_tx_poll(&counters) == 0);
+	CHECK(counters.sent == sent + 6);
+	CHECK(rf24_transmit_packet(_packet, 32) == 0);
+}
+
+
+/* Received packets drained to the queue by the IRQ handler, the rest read from the FIFO as the queue empties */
+static void test_irq_receive(void)
+{
+	uint8_t buf[32];
+	uint8_t len;
+	uint8_t i;
+
+	CHECK(rf24_init(RF24_MODE_PRX, _address) == 0);
+	for(i = 0; i < CONFIG_RF24_RX_QUEUE_DEPTH + 3; i++) {
+		_packet[0] = i;
+		CHECK(spi_sim_nrf24_receive(&_radio, RF24_PIPE0, _packet, 4));
+		_delay_us(100);
+	}
+	CHECK(_radio.rx_count == 3);
+	CHECK(!spi_sim_nrf24_receive(&_radio, RF24_PIPE0, _packet, 4));	/* Queue and FIFO full */
+	for(i = 0; i < CONFIG_RF24_RX_QUEUE_DEPTH + 3; i++) {
+		CHECK(rf24_receive_packet(buf, &len) == RF24_PIPE0);
+		CHECK((len == 4) && (buf[0] == i));
+		CHECK(EIMSK & _BV(INT1));
+	}
+	rf24_receive_packet(buf, &len);
+	CHECK(len == 0);
+	CHECK(_radio.rx_count == 0);
+}
+
+
+/* IRQ taken while the bus is held during the Rx FIFO drain of rf24_receive_packet() (INT1 masked) */
+static uint8_t	_probe_armed;
+static uint8_t	_probe_fired;
+static uint8_t	_probe_unmasked;
+
+static void probe_poll(void)
+{
+	if(!_probe_armed || !_radio.dev.selected) {
+		return;
+	}
+	if(!_probe_fired && !(EIMSK & _BV(INT1))) {
+		_probe_fired = 1;
+		sim_interrupt(INT1_vect);
+	}
+	else if(_probe_fired && (EIMSK & _BV(INT1))) {
+		_probe_unmasked++;
+	}
+}
+
+static sim_peripheral_t	_probe = { probe_poll, 0, 0, 0 };
+
+/* IRQ while the bus is busy: masked, and unmasked from SPI_Release() */
+static void test_irq_busy(void)
+{
+	spi_device_t other;
+	uint8_t buf[32];
+	uint8_t len;
+	uint8_t i;
+
+	SPI_Device_Init(&other, SPI_MODE0, SPI_CLKDIV_4, &PORTB, &DDRB, PB0);
+	CHECK(rf24_init(RF24_MODE_PRX, _address) == 0);
+
+	SPI_Acquire(&other);
+	_packet[0] = 7;
+	CHECK(spi_sim_nrf24_receive(&_radio, RF24_PIPE0, _packet, 4));
+	_delay_us(100);
+	CHECK(!(EIMSK & _BV(INT1)));
+	CHECK(_radio.rx_count == 1);
+	SPI_Release(&other);
+	CHECK(EIMSK & _BV(INT1));
+	_delay_us(100);
+	CHECK(_radio.rx_count == 0);
+	CHECK(rf24_receive_packet(buf, &len) == RF24_PIPE0);
+	CHECK((len == 4) && (buf[0] == 7));
+
+	/* Deferred during the drain: not unmasked before the drain ends */
+	for(i = 0; i < CONFIG_RF24_RX_QUEUE_DEPTH + 3; i++) {
+		CHECK(spi_sim_nrf24_receive(&_radio, RF24_PIPE0, _packet, 4));
+		_delay_us(100);
+	}
+	sim_add_peripheral(&_probe);
+	_probe_armed = 1;
+	_probe_fired = 0;
+	_probe_unmasked = 0;
+	rf24_receive_packet(buf, &len);
+	_probe_armed = 0;
+	CHECK(_probe_fired);
+	CHECK(_probe_unmasked == 0);
+	CHECK(EIMSK & _BV(INT1));
+	for(i = 0; i < CONFIG_RF24_RX_QUEUE_DEPTH + 2; i++) {
+		rf24_receive_packet(buf, &len);
+		CHECK(len == 4);
+	}
+
+	/* Deferred entry ran: deferring again works */
+	SPI_Acquire(&other);
+	CHECK(spi_sim_nrf24_receive(&_radio, RF24_PIPE0, _packet, 4));
+	_delay_us(100);
+	CHECK(!(EIMSK & _BV(INT1)));
+	SPI_Release(&other);
+	_delay_us(100);
+	CHECK(_radio.rx_count == 0);
+	rf24_receive_packet(buf, &len);
+	CHECK(len == 4);
+}
+#endif
+
+
+static const struct {
+	const char	*name;
+	void		(*run)(void);
+} _tests[] = {
+	{ "transmit", test_transmit },
+	{ "timeout", test_timeout },
+	{ "queue", test_queue },
+	{ "stream", test_stream },
+	{ "shadow", test_shadow },
+	{ "receive", test_receive },
+	{ "pipes", test_pipes },
+#if CONFIG_RF24_RUNTIME_CONFIG
+	{ "config", test_config },
+#endif
+#if !CONFIG_RF24_POLLED_MODE
+	{ "irq queue", test_irq_queue },
+	{ "irq receive", test_irq_receive },
+	{ "irq busy", test_irq_busy },
+#endif
+};
+
+
+int main(void)
+{
+	unsigned i;
+	unsigned failures;
+
+	for(i = 0; i < sizeof(_tests) / sizeof(_tests[0]); i++) {
+		failures = _failures;
+		test_setup();
+		_tests[i].run();
+		printf("%-16s %s\n", _tests[i].name, (_failures == failures) ? "ok" : "FAILED");
+	}
+	return _failures ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+/*
+ *	sim.c
+ *
+ *	Host simulation core
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include "sim.h"
+
+#define SIM_NS_PER_SEC			1000000000ULL
+
+/* I/O registers (avr/io.h). Input pins read high (pull-ups) */
+#undef SIM_REG8
+#undef SIM_REG16
+#define SIM_REG8(name)			volatile uint8_t name;
+#define SIM_REG16(name)			volatile uint16_t name;
+SIM_REG8(SREG)
+volatile uint8_t PINB = 0xFF;	SIM_REG8(DDRB)	SIM_REG8(PORTB)
+volatile uint8_t PINC = 0xFF;	SIM_REG8(DDRC)	SIM_REG8(PORTC)
+volatile uint8_t PIND = 0xFF;	SIM_REG8(DDRD)	SIM_REG8(PORTD)
+SIM_REG8(EICRA)	SIM_REG8(EIMSK)	SIM_REG8(EIFR)	SIM_REG8(PCICR)
+SIM_REG8(SMCR)	SIM_REG8(MCUCR)	SIM_REG8(MCUSR)	SIM_REG8(PRR)
+SIM_REG8(TCCR0A)	SIM_REG8(TCCR0B)	SIM_REG8(TCNT0)	SIM_REG8(OCR0A)	SIM_REG8(OCR0B)	SIM_REG8(TIMSK0)	SIM_REG8(TIFR0)
+SIM_REG8(TCCR1A)	SIM_REG8(TCCR1B)	SIM_REG8(TCCR1C)	SIM_REG16(TCNT1)	SIM_REG16(OCR1A)	SIM_REG16(OCR1B)	SIM_REG8(TIMSK1)	SIM_REG8(TIFR1)
+SIM_REG8(TCCR2A)	SIM_REG8(TCCR2B)	SIM_REG8(TCNT2)	SIM_REG8(OCR2A)	SIM_REG8(OCR2B)	SIM_REG8(TIMSK2)	SIM_REG8(TIFR2)
+SIM_REG8(SPCR)	SIM_REG8(SPSR)	SIM_REG8(SPDR)
+SIM_REG8(TWBR)	volatile uint8_t TWSR = 0xF8;	volatile uint8_t TWAR = 0xFE;	volatile uint8_t TWDR = 0xFF;	SIM_REG8(TWCR)	SIM_REG8(TWAMR)
+SIM_REG8(UCSR0A)	SIM_REG8(UCSR0B)	SIM_REG8(UCSR0C)	SIM_REG16(UBRR0)	SIM_REG8(UDR0)
+
+static uint64_t			_sim_now;
+static sim_peripheral_t	*_sim_periphs;
+static uint8_t			_sim_in_advance;
+
+/* Vectors of the program, if defined */
+void INT0_vect(void) __attribute__((weak));
+void INT1_vect(void) __attribute__((weak));
+
+
+void sim_add_peripheral(sim_peripheral_t *periph)
+{
+	sim_peripheral_t *p;
+
+	for(p = _sim_periphs; p; p = p->next) {
+		if(p == periph) {
+			return;
+		}
+	}
+	periph->next = _sim_periphs;
+	_sim_periphs = periph;
+}
+
+
+void sim_reset(void)
+{
+	_sim_now = 0;
+	SREG = 0;
+	PINB = PINC = PIND = 0xFF;
+	DDRB = DDRC = DDRD = 0;
+	PORTB = PORTC = PORTD = 0;
+	TWBR = 0;
+	TWSR = 0xF8;
+	TWAR = 0xFE;
+	TWDR = 0xFF;
+	TWCR = 0;
+	TWAMR = 0;
+	SPCR = SPSR = SPDR = 0;
+	EICRA = EIMSK = EIFR = 0;
+	TCNT1 = 0;
+}
+
+
+uint64_t sim_now_ns(void)
+{
+	return _sim_now;
+}
+
+
+uint64_t sim_cycles(void)
+{
+	return (_sim_now * (F_CPU / 1000)) / (SIM_NS_PER_SEC / 1000);
+}
+
+
+/* External interrupts with low level sense: run while the pin is LOW */
+static void sim_ext_int(void)
+{
+	void (*vector)(void);
+	uint8_t n;
+
+	for(n = 0; n < 2; n++) {
+		vector = n ? INT1_vect : INT0_vect;
+		if(vector && (EIMSK & _BV(INT0 + n)) && !(EICRA & (3 << (2 * n))) && !(PIND & _BV(PD2 + n))) {
+			sim_interrupt(vector);
+		}
+	}
+}
+
+
+/* Handles register writes of all peripherals, then the pin interrupts they raised */
+static void sim_poll(void)
+{
+	sim_peripheral_t *p;
+
+	TCNT1 = (uint16_t)sim_cycles();		/* Timer1 runs freely at F_CPU (used by TWI_STATS_TIME()) */
+	for(p = _sim_periphs; p; p = p->next) {
+		if(p->poll) {
+			p->poll();
+		}
+	}
+	sim_ext_int();
+}
+
+
+volatile uint8_t *sim_pin(volatile uint8_t *reg)
+{
+	sim_poll();
+	return reg;
+}
+
+
+void sim_advance_ns(uint64_t ns)
+{
+	uint64_t target = _sim_now + ns;
+	sim_peripheral_t *p, *first;
+	uint64_t t, first_t;
+
+	/* Called from an interrupt handler: time is advanced by the outer call */
+	if(_sim_in_advance) {
+		_sim_now = target;
+		return;
+	}
+	_sim_in_advance = 1;
+	for(;;) {
+		sim_poll();
+		/* Earliest event up to target */
+		first = 0;
+		first_t = target;
+		for(p = _sim_periphs; p; p = p->next) {
+			t = p->next_event ? p->next_event() : UINT64_MAX;
+			if(t <= first_t) {
+				first = p;
+				first_t = t;
+			}
+		}
+		if(!first) {
+			break;
+		}
+		if(first_t > _sim_now) {
+			_sim_now = first_t;
+		}
+		first->event();
+	}
+	if(target > _sim_now) {
+		_sim_now = target;
+	}
+	sim_poll();
+	_sim_in_advance = 0;
+}
+
+
+void sim_sleep(void)
+{
+	sim_peripheral_t *p;
+	uint64_t t, wake = _sim_now + SIM_SLEEP_TICK_NS;
+
+	if(!(SMCR & _BV(SE))) {
+		return;
+	}
+	sim_poll();
+	for(p = _sim_periphs; p; p = p->next) {
+		t = p->next_event ? p->next_event() : UINT64_MAX;
+		if(t < wake) {
+			wake = t;
+		}
+	}
+	sim_advance_ns((wake > _sim_now) ? (wake - _sim_now) : 0);
+}
+
+
+uint8_t sim_interrupt(void (*vector)(void))
+{
+	if(!(SREG & 0x80)) {
+		return 0;
+	}
+	SREG &= ~0x80;
+	vector();
+	SREG |= 0x80;
+	return 1;
+}
@@ -0,0 +1,74 @@
+/*
+ *	sim.h
+ *
+ *	Host simulation core : simulated time and peripheral scheduling
+ *
+ *	The firmware code runs natively and takes no simulated time, except in delays (_delay_us(),
+ *	_delay_ms(), _delay_loop_1/2()) and sleep (sleep_cpu()). Simulated peripherals progress only when the time advances, so a driver
+ *	waiting for an interrupt must poll with a delay (eg: avr_twi.c with TWI_TIMEOUT_US != 0).
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+/* A simulated peripheral */
+typedef struct sim_peripheral {
+	void		(*poll)(void);			/* Handles register writes and raises interrupts */
+	uint64_t	(*next_event)(void);	/* Time (ns) of the next event, UINT64_MAX if none */
+	void		(*event)(void);			/* Runs the event due at the current time */
+	struct sim_peripheral *next;
+} sim_peripheral_t;
+
+
+/* Registers a peripheral. Done by the peripheral models (eg: twi_sim_init()) */
+void sim_add_peripheral(sim_peripheral_t *periph);
+
+
+/* Resets time and I/O registers to their reset values (peripherals stay registered) */
+void sim_reset(void);
+
+
+/* Current simulated time in ns */
+uint64_t sim_now_ns(void);
+
+
+/* Current simulated time in CPU cycles of F_CPU */
+uint64_t sim_cycles(void);
+
+
+/* Input register read right after the code changed a pin (eg: open-drain line released with DDR): the peripherals
+ * update the pins they drive first. Used in the pin definitions of the host build (eg: soft_twi_config.h)
+ */
+volatile uint8_t *sim_pin(volatile uint8_t *reg);
+
+
+/* Advances the time by ns, running all the peripheral events on the way */
+void sim_advance_ns(uint64_t ns);
+
+
+/* Period (ns) of the wake-up tick assumed while sleeping with no peripheral event due */
+#ifndef SIM_SLEEP_TICK_NS
+#define SIM_SLEEP_TICK_NS		1000000ULL
+#endif
+
+
+/* sleep_cpu() : advances the time to the next peripheral event, or by SIM_SLEEP_TICK_NS if there is none.
+ * Only sleeps if sleep is enabled (SE bit of SMCR).
+ */
+void sim_sleep(void);
+
+
+/* Runs the interrupt vector, if interrupts are enabled (SREG I bit). Returns 1 if it was run */
+uint8_t sim_interrupt(void (*vector)(void));
+
+
+/* External interrupts INT0 (PD2) and INT1 (PD3), low level sense only (ISC bits of EICRA 00): ISR(INT0_vect) or
+ * ISR(INT1_vect) of the program runs while the pin reads LOW in PIND, the interrupt is enabled in EIMSK and
+ * interrupts are enabled. Checked after the peripherals are polled, when the time advances: an interrupt
+ * enabled by sei() or EIMSK runs at the next delay or SPI byte. Device models drive the pins (eg: irq_port of
+ * spi_sim_nrf24_t).
+ */
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ *	soft_twi_config.h for host simulation
+ *
+ *	soft_twi.c on PC0 (SCL) and PC1 (SDA), with the pin-level bus model of twi_sim_devices.h. The PIN register
+ *	is read through sim_pin(), so a line released just before is seen at its new level.
+ */
+
+#ifndef SOFT_TWI_CONFIG_H
+#define SOFT_TWI_CONFIG_H
+
+#include "sim.h"
+
+#define SOFT_TWI_PORT		PORTC
+#define SOFT_TWI_DDR		DDRC
+#define SOFT_TWI_PIN		(*sim_pin(&PINC))
+#define SOFT_TWI_SCL_BIT	0
+#define SOFT_TWI_SDA_BIT	1
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ *	spi_config.h for host simulation
+ *
+ *	avr_spi.c with the simulated bus (spi_sim.c), on the pins of the ATmega328P SPI module. Other backends are
+ *	built for the tests with -DSPI_BACKEND=...
+ */
+
+#ifndef SPI_CONFIG_H
+#define SPI_CONFIG_H
+
+#ifndef SPI_BACKEND
+#define SPI_BACKEND		SPI_BACKEND_HOST
+#endif
+
+#define SPI_PORT		PORTB
+#define SPI_DDR			DDRB
+#define SPI_PIN			PINB
+#define MOSI_BIT		3
+#define MISO_BIT		4
+#define SCK_BIT			5
+#define SS_BIT			2
+
+#endif
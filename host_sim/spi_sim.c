@@ -0,0 +1,199 @@
+/*
+ *	spi_sim.c
+ *
+ *	Simulated SPI bus for the host build of avr_spi.c (SPI_BACKEND_HOST)
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include "sim.h"
+#include "spi_sim.h"
+
+static spi_sim_device_t			*_devices;
+static uint8_t					_loopback;
+static spi_sim_transaction_t	_cur;			/* Transaction in progress */
+static uint8_t					_open;
+static spi_sim_transaction_t	_trace[SPI_SIM_TRACE_LEN];
+static uint16_t					_trace_first;
+static uint16_t					_trace_count;
+static spi_sim_stats_t			_stats;
+
+static sim_peripheral_t			_spi_periph = { spi_sim_cs_update, 0, 0, 0 };
+
+
+uint32_t spi_sim_sck_hz(void)
+{
+	static const uint8_t div[] = { 4, 16, 64, 128 };
+	uint32_t hz = F_CPU / div[SPCR & 0x3];
+
+	if(SPSR & _BV(SPI2X)) {
+		hz *= 2;
+	}
+	return hz;
+}
+
+
+/* Ends the transaction in progress and adds it to the trace */
+static void spi_sim_close(void)
+{
+	uint16_t i;
+
+	if(!_open) {
+		return;
+	}
+	_open = 0;
+	_cur.end_ns = sim_now_ns();
+	_stats.transactions++;
+	if(_trace_count < SPI_SIM_TRACE_LEN) {
+		i = (_trace_first + _trace_count++) % SPI_SIM_TRACE_LEN;
+	}
+	else {
+		i = _trace_first;
+		_trace_first = (_trace_first + 1) % SPI_SIM_TRACE_LEN;
+	}
+	_trace[i] = _cur;
+}
+
+
+void spi_sim_cs_update(void)
+{
+	spi_sim_device_t *dev;
+
+	for(dev = _devices; dev; dev = dev->next) {
+		if(dev->selected && (*dev->cs_port & dev->cs_mask)) {
+			dev->selected = 0;
+			if(dev->deselect) {
+				dev->deselect(dev);
+			}
+			if(_open && (_cur.dev == dev)) {
+				spi_sim_close();
+			}
+		}
+	}
+	for(dev = _devices; dev; dev = dev->next) {
+		if(!dev->selected && !(*dev->cs_port & dev->cs_mask)) {
+			dev->selected = 1;
+			if(!_open) {
+				memset(&_cur, 0, sizeof(_cur));
+				_cur.dev = dev;
+				_cur.start_ns = sim_now_ns();
+				_open = 1;
+			}
+			if(dev->select) {
+				dev->select(dev);
+			}
+		}
+	}
+}
+
+
+uint8_t spi_sim_xfer(uint8_t mosi)
+{
+	spi_sim_device_t *dev;
+	uint8_t miso = 0xFF, selected = 0;
+	uint64_t ns;
+
+	spi_sim_cs_update();
+	for(dev = _devices; dev; dev = dev->next) {
+		if(dev->selected) {
+			/* Open-drain like: MISO of several selected devices are ANDed */
+			miso &= dev->xfer ? dev->xfer(dev, mosi) : 0xFF;
+			selected = 1;
+		}
+	}
+	if(!selected) {
+		_stats.unselected++;
+		if(_loopback) {
+			miso = mosi;
+		}
+	}
+	else if(_open) {
+		if(_cur.bytes < SPI_SIM_TRACE_BYTES) {
+			_cur.mosi[_cur.bytes] = mosi;
+			_cur.miso[_cur.bytes] = miso;
+		}
+		_cur.bytes++;
+	}
+	_stats.bytes++;
+	ns = (8 * 1000000000ULL) / spi_sim_sck_hz() + (SPI_SIM_GAP_CYCLES * 1000000000ULL) / F_CPU;
+	_stats.busy_ns += ns;
+	sim_advance_ns(ns);
+	return miso;
+}
+
+
+void spi_sim_init(void)
+{
+	_devices = 0;
+	_loopback = 0;
+	_open = 0;
+	spi_sim_trace_clear();
+	spi_sim_stats_reset();
+	sim_add_peripheral(&_spi_periph);
+}
+
+
+void spi_sim_attach(spi_sim_device_t *dev)
+{
+	spi_sim_detach(dev);
+	dev->selected = 0;
+	dev->next = _devices;
+	_devices = dev;
+}
+
+
+void spi_sim_detach(spi_sim_device_t *dev)
+{
+	spi_sim_device_t **p;
+
+	for(p = &_devices; *p; p = &(*p)->next) {
+		if(*p == dev) {
+			*p = dev->next;
+			if(_open && (_cur.dev == dev)) {
+				spi_sim_close();
+			}
+			return;
+		}
+	}
+}
+
+
+void spi_sim_loopback(uint8_t on)
+{
+	_loopback = on;
+}
+
+
+uint16_t spi_sim_trace_count(void)
+{
+	return _trace_count;
+}
+
+
+const spi_sim_transaction_t *spi_sim_trace_get(uint16_t i)
+{
+	if(i >= _trace_count) {
+		return 0;
+	}
+	return &_trace[(_trace_first + i) % SPI_SIM_TRACE_LEN];
+}
+
+
+void spi_sim_trace_clear(void)
+{
+	_trace_first = 0;
+	_trace_count = 0;
+}
+
+
+void spi_sim_stats_get(spi_sim_stats_t *stats)
+{
+	*stats = _stats;
+}
+
+
+void spi_sim_stats_reset(void)
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
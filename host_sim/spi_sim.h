@@ -0,0 +1,109 @@
+/*
+ *	spi_sim.h
+ *
+ *	Simulated SPI bus for the host build of avr_spi.c (SPI_BACKEND_HOST)
+ *
+ *	Each byte of SPI_TxRx() is exchanged with the device model whose CS pin (PORT bit) is LOW, and
+ *	advances the simulated time by 8 SCK periods of the SPCR/SPSR clock rate. With no device selected the
+ *	bus is looped back (MISO = MOSI) or reads 0xFF. Every CS-framed transaction is recorded in a trace.
+ *
+ *	CS changes are seen by SPI_Acquire()/SPI_Release(), before each byte and when the time advances. A CS
+ *	pin set HIGH then LOW again directly (SS_HIGH(); SS_LOW();) with no byte or delay in between is one
+ *	transaction.
+ */
+
+#ifndef SPI_SIM_H
+#define SPI_SIM_H
+
+#include <stdint.h>
+
+/* Number of transactions kept in the trace (older ones are dropped) */
+#ifndef SPI_SIM_TRACE_LEN
+#define SPI_SIM_TRACE_LEN		256
+#endif
+
+/* First MOSI bytes of each transaction kept in the trace (command, register...) */
+#ifndef SPI_SIM_TRACE_BYTES
+#define SPI_SIM_TRACE_BYTES		4
+#endif
+
+/* CPU cycles between two bytes of SPI_TxRx() (polling SPIF, loading the next byte) */
+#ifndef SPI_SIM_GAP_CYCLES
+#define SPI_SIM_GAP_CYCLES		4
+#endif
+
+/* A device on the bus. Device models embed this as their first member */
+typedef struct spi_sim_device {
+	volatile uint8_t	*cs_port;		/* PORT register of the CS pin */
+	uint8_t				cs_mask;
+	void		(*select)(struct spi_sim_device *dev);					/* CS went LOW */
+	uint8_t		(*xfer)(struct spi_sim_device *dev, uint8_t mosi);		/* Byte exchanged, returns MISO byte */
+	void		(*deselect)(struct spi_sim_device *dev);				/* CS went HIGH */
+	uint8_t		selected;
+	struct spi_sim_device *next;
+} spi_sim_device_t;
+
+/* A CS-framed transaction */
+typedef struct {
+	spi_sim_device_t	*dev;			/* Device selected */
+	uint64_t			start_ns;		/* Time of CS LOW */
+	uint64_t			end_ns;			/* Time of CS HIGH */
+	uint16_t			bytes;			/* Bytes exchanged */
+	uint8_t				mosi[SPI_SIM_TRACE_BYTES];	/* First bytes sent */
+	uint8_t				miso[SPI_SIM_TRACE_BYTES];	/* First bytes received */
+} spi_sim_transaction_t;
+
+/* Bus counters since spi_sim_init() or spi_sim_stats_reset() */
+typedef struct {
+	uint32_t	transactions;	/* Completed transactions */
+	uint32_t	bytes;			/* Bytes exchanged, including those with no device selected */
+	uint32_t	unselected;		/* Bytes exchanged with no device selected (not in the trace) */
+	uint64_t	busy_ns;		/* Time spent shifting bytes */
+} spi_sim_stats_t;
+
+
+/* Resets the bus (no devices, loopback off, empty trace) and registers it with the simulator */
+void spi_sim_init(void);
+
+
+/* Connects a device to the bus. Its CS pin should be HIGH */
+void spi_sim_attach(spi_sim_device_t *dev);
+
+
+/* Disconnects a device from the bus */
+void spi_sim_detach(spi_sim_device_t *dev);
+
+
+/* With loopback on, a byte exchanged with no device selected is read back. Otherwise 0xFF is read */
+void spi_sim_loopback(uint8_t on);
+
+
+/* Exchanges a byte with the selected device. Called by SPI_TxRx() */
+uint8_t spi_sim_xfer(uint8_t mosi);
+
+
+/* Checks the CS pins and starts or ends transactions */
+void spi_sim_cs_update(void);
+
+
+/* SCK frequency (Hz) from SPCR and SPSR */
+uint32_t spi_sim_sck_hz(void);
+
+
+/* Number of transactions in the trace (at most SPI_SIM_TRACE_LEN) */
+uint16_t spi_sim_trace_count(void);
+
+
+/* Transaction i of the trace, 0 being the oldest kept. 0 if i is out of range */
+const spi_sim_transaction_t *spi_sim_trace_get(uint16_t i);
+
+
+void spi_sim_trace_clear(void);
+
+
+void spi_sim_stats_get(spi_sim_stats_t *stats);
+
+
+void spi_sim_stats_reset(void);
+
+#endif
@@ -0,0 +1,611 @@
+/*
+ *	spi_sim_devices.c
+ *
+ *	Model of nRF24L01+ for the simulated SPI bus, and pin-level SPI slave
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "sim.h"
+#include "spi_sim_devices.h"
+
+
+/**************************** nRF24L01+ ********************************/
+
+/* Registers */
+#define NRF_CONFIG				0x00
+#define NRF_EN_AA				0x01
+#define NRF_EN_RXADDR			0x02
+#define NRF_SETUP_AW			0x03
+#define NRF_SETUP_RETR			0x04
+#define NRF_RF_CH				0x05
+#define NRF_RF_SETUP			0x06
+#define NRF_STATUS				0x07
+#define NRF_OBSERVE_TX			0x08
+#define NRF_RX_ADDR_P0			0x0A
+#define NRF_RX_ADDR_P1			0x0B
+#define NRF_TX_ADDR				0x10
+#define NRF_RX_PW_P0			0x11
+#define NRF_FIFO_STATUS			0x17
+#define NRF_DYNPD				0x1C
+#define NRF_FEATURE				0x1D
+
+/* Commands */
+#define NRF_W_REGISTER			0x20
+#define NRF_ACTIVATE			0x50
+#define NRF_R_RX_PL_WID			0x60
+#define NRF_R_RX_PAYLOAD		0x61
+#define NRF_W_TX_PAYLOAD		0xA0
+#define NRF_W_ACK_PAYLOAD		0xA8
+#define NRF_W_TX_PAYLOAD_NOACK	0xB0
+#define NRF_FLUSH_TX			0xE1
+#define NRF_FLUSH_RX			0xE2
+#define NRF_REUSE_TX_PL			0xE3
+#define NRF_NOP					0xFF
+
+#define NRF_PWR_UP				0x02
+#define NRF_PRIM_RX				0x01
+#define NRF_RX_DR				0x40
+#define NRF_TX_DS				0x20
+#define NRF_MAX_RT				0x10
+#define NRF_IRQ_FLAGS			(NRF_RX_DR | NRF_TX_DS | NRF_MAX_RT)
+#define NRF_EN_DPL				0x04
+
+#define NRF_SETTLE_NS			130000ULL	/* PLL settling, before TX and before receiving the ACK */
+
+static spi_sim_nrf24_t	*_nrf24_list;
+
+static void nrf24_poll(void);
+static uint64_t nrf24_next_event(void);
+static void nrf24_event(void);
+
+static sim_peripheral_t	_nrf24_periph = { nrf24_poll, nrf24_next_event, nrf24_event, 0 };
+
+
+static uint8_t nrf24_addr_width(spi_sim_nrf24_t *rf)
+{
+	uint8_t aw = rf->regs[NRF_SETUP_AW] & 0x3;
+
+	return aw ? aw + 2 : 3;
+}
+
+
+/* Air time of a packet with len payload bytes (ns) */
+static uint64_t nrf24_air_ns(spi_sim_nrf24_t *rf, uint8_t len)
+{
+	uint8_t setup = rf->regs[NRF_RF_SETUP];
+	uint32_t bps = 1000000;
+	uint32_t bits;
+
+	if(setup & 0x20) {
+		bps = 250000;
+	}
+	else if(setup & 0x08) {
+		bps = 2000000;
+	}
+	/* Preamble, address, payload and CRC bytes, and 9 bits of packet control field */
+	bits = 8 * (1 + nrf24_addr_width(rf) + len) + 9;
+	if(rf->regs[NRF_CONFIG] & 0x08) {
+		bits += (rf->regs[NRF_CONFIG] & 0x04) ? 16 : 8;
+	}
+	return (bits * 1000000000ULL) / bps;
+}
+
+
+static uint8_t nrf24_status(spi_sim_nrf24_t *rf)
+{
+	uint8_t status = rf->regs[NRF_STATUS] & NRF_IRQ_FLAGS;
+
+	status |= (rf->rx_count ? rf->rx_fifo[0].pipe : 7) << 1;
+	if(rf->tx_count == 3) {
+		status |= 0x01;
+	}
+	return status;
+}
+
+
+static uint8_t nrf24_fifo_status(spi_sim_nrf24_t *rf)
+{
+	uint8_t fs = 0;
+
+	if(rf->tx_reuse) {
+		fs |= 0x40;
+	}
+	if(rf->tx_count == 3) {
+		fs |= 0x20;
+	}
+	if(!rf->tx_count) {
+		fs |= 0x10;
+	}
+	if(rf->rx_count == 3) {
+		fs |= 0x02;
+	}
+	if(!rf->rx_count) {
+		fs |= 0x01;
+	}
+	return fs;
+}
+
+
+/* TX mode period from tx_mode_start to end (ns) */
+static void nrf24_tx_mode(spi_sim_nrf24_t *rf, uint64_t end)
+{
+	if(end - rf->tx_mode_start > rf->tx_mode_max_ns) {
+		rf->tx_mode_max_ns = end - rf->tx_mode_start;
+	}
+}
+
+
+/* Starts sending the packet at the head of the TX FIFO. chain: follows a packet without ACK, in TX mode */
+static void nrf24_tx_start(spi_sim_nrf24_t *rf, uint8_t chain)
+{
+	spi_sim_nrf24_packet_t *pkt = &rf->tx_fifo[0];
+	uint8_t retr = rf->regs[NRF_SETUP_RETR];
+	uint8_t arc = retr & 0xF;
+	uint64_t ard = ((retr >> 4) + 1) * 250000ULL;
+	uint64_t air = nrf24_air_ns(rf, pkt->len);
+	uint64_t ack_air = nrf24_air_ns(rf, 0);
+	uint64_t now = sim_now_ns();
+	uint64_t t = now + NRF_SETTLE_NS;
+	uint8_t ack = (rf->regs[NRF_EN_AA] & 0x01) && !pkt->noack;
+	uint8_t n;
+
+	rf->tx_busy = 1;
+	if(ack) {
+		chain = 0;
+	}
+	if(!chain) {
+		rf->tx_mode_start = now;
+	}
+	if(!ack) {
+		/* Sent once, no ACK expected: TX_DS even if the peer misses it. Following the previous packet
+		 * without ACK, the radio is still in TX mode and does not settle again */
+		if(chain) {
+			t = now;
+		}
+		rf->tx_attempts = 1;
+		rf->tx_ok = 1;
+		rf->tx_delivered = rf->link && !rf->lose;
+		if(rf->lose) {
+			rf->lose--;
+		}
+		rf->air_ns += air;
+		rf->tx_end = t + air;
+		nrf24_tx_mode(rf, rf->tx_end);
+		return;
+	}
+	/* Lost attempts then an acknowledged one, or arc + 1 lost attempts */
+	for(n = 1; ; n++) {
+		if(rf->link && !rf->lose) {
+			rf->tx_ok = 1;
+			break;
+		}
+		if(rf->lose) {
+			rf->lose--;
+		}
+		if(n == arc + 1) {
+			rf->tx_ok = 0;
+			break;
+		}
+	}
+	rf->tx_attempts = n;
+	rf->tx_delivered = rf->tx_ok;
+	rf->air_ns += n * air + (rf->tx_ok ? ack_air : 0);
+	rf->tx_end = t + (n - 1) * ard + air + NRF_SETTLE_NS + (rf->tx_ok ? ack_air : 0);
+	nrf24_tx_mode(rf, t + air);		/* RX mode for the ACK after each attempt */
+}
+
+
+/* End of the transmission in progress */
+static void nrf24_tx_done(spi_sim_nrf24_t *rf)
+{
+	uint8_t *observe = &rf->regs[NRF_OBSERVE_TX];
+	spi_sim_nrf24_packet_t pkt = rf->tx_fifo[0];
+
+	rf->tx_busy = 0;
+	rf->tx_noack = pkt.noack || !(rf->regs[NRF_EN_AA] & 0x01);
+	rf->attempts += rf->tx_attempts;
+	*observe = (*observe & 0xF0) | ((rf->tx_attempts - 1) & 0x0F);
+	if(!rf->tx_ok) {
+		/* Payload stays in the FIFO, transmission stops until MAX_RT is cleared */
+		rf->regs[NRF_STATUS] |= NRF_MAX_RT;
+		rf->max_rt++;
+		if((*observe >> 4) < 0xF) {
+			*observe += 0x10;
+		}
+		return;
+	}
+	if(!rf->tx_reuse) {
+		rf->tx_count--;
+		memmove(&rf->tx_fifo[0], &rf->tx_fifo[1], rf->tx_count * sizeof(rf->tx_fifo[0]));
+	}
+	rf->regs[NRF_STATUS] |= NRF_TX_DS;
+	if(rf->tx_delivered) {
+		rf->packets_tx++;
+		if(rf->on_tx) {
+			rf->on_tx(rf, &pkt);
+		}
+	}
+}
+
+
+/* Drives the pin connected to IRQ */
+static void nrf24_irq_out(spi_sim_nrf24_t *rf)
+{
+	if(!rf->irq_port) {
+		return;
+	}
+	if(spi_sim_nrf24_irq_pin(rf)) {
+		*rf->irq_port |= rf->irq_mask;
+	}
+	else {
+		*rf->irq_port &= ~rf->irq_mask;
+	}
+}
+
+
+/* Samples CE and runs the PTX state machine up to the current time */
+static void nrf24_update(spi_sim_nrf24_t *rf)
+{
+	uint8_t config = rf->regs[NRF_CONFIG];
+	uint8_t chain = 0;
+
+	if(*rf->ce_port & rf->ce_mask) {
+		rf->ce_seen = 1;
+	}
+	if(rf->tx_busy && (sim_now_ns() >= rf->tx_end)) {
+		nrf24_tx_done(rf);
+		/* Stays in TX mode only while CE is HIGH */
+		rf->ce_seen = (*rf->ce_port & rf->ce_mask) != 0;
+		chain = rf->ce_seen && rf->tx_noack;
+	}
+	if(!rf->tx_busy && rf->ce_seen && (config & NRF_PWR_UP) && !(config & NRF_PRIM_RX)
+	   && rf->tx_count && !(rf->regs[NRF_STATUS] & NRF_MAX_RT)) {
+		nrf24_tx_start(rf, chain);
+	}
+	if(!(*rf->ce_port & rf->ce_mask) && !rf->tx_busy) {
+		rf->ce_seen = 0;
+	}
+	nrf24_irq_out(rf);
+}
+
+
+static void nrf24_poll(void)
+{
+	spi_sim_nrf24_t *rf;
+
+	for(rf = _nrf24_list; rf; rf = rf->next) {
+		nrf24_update(rf);
+	}
+}
+
+
+static uint64_t nrf24_next_event(void)
+{
+	spi_sim_nrf24_t *rf;
+	uint64_t t = UINT64_MAX;
+
+	for(rf = _nrf24_list; rf; rf = rf->next) {
+		if(rf->tx_busy && (rf->tx_end < t)) {
+			t = rf->tx_end;
+		}
+	}
+	return t;
+}
+
+
+static void nrf24_event(void)
+{
+	nrf24_poll();
+}
+
+
+/* Multi-byte address register, or 0 */
+static uint8_t *nrf24_addr_reg(spi_sim_nrf24_t *rf, uint8_t reg)
+{
+	switch(reg) {
+	case NRF_RX_ADDR_P0:	return rf->rx_addr_p0;
+	case NRF_RX_ADDR_P1:	return rf->rx_addr_p1;
+	case NRF_TX_ADDR:		return rf->tx_addr;
+	default:				return 0;
+	}
+}
+
+
+static void nrf24_write_reg(spi_sim_nrf24_t *rf, uint8_t reg, uint8_t value)
+{
+	uint8_t *addr = nrf24_addr_reg(rf, reg);
+
+	if(addr) {
+		if(rf->idx < 5) {
+			addr[rf->idx] = value;
+		}
+		return;
+	}
+	if(rf->idx) {
+		return;
+	}
+	switch(reg) {
+	case NRF_STATUS:
+		/* Interrupt flags are cleared by writing 1 */
+		rf->regs[NRF_STATUS] &= ~(value & NRF_IRQ_FLAGS);
+		break;
+	case NRF_RF_CH:
+		rf->regs[NRF_RF_CH] = value & 0x7F;
+		rf->regs[NRF_OBSERVE_TX] &= 0x0F;	/* PLOS_CNT reset */
+		break;
+	case NRF_OBSERVE_TX:
+	case NRF_FIFO_STATUS:
+	case 0x09:	/* RPD */
+		break;
+	default:
+		rf->regs[reg] = value;
+		break;
+	}
+}
+
+
+static uint8_t nrf24_read_reg(spi_sim_nrf24_t *rf, uint8_t reg)
+{
+	uint8_t *addr = nrf24_addr_reg(rf, reg);
+
+	if(addr) {
+		return (rf->idx < 5) ? addr[rf->idx] : 0x00;
+	}
+	if(reg == NRF_STATUS) {
+		return nrf24_status(rf);
+	}
+	if(reg == NRF_FIFO_STATUS) {
+		return nrf24_fifo_status(rf);
+	}
+	return rf->regs[reg];
+}
+
+
+static void nrf24_select(spi_sim_device_t *dev)
+{
+	spi_sim_nrf24_t *rf = (spi_sim_nrf24_t *)dev;
+
+	nrf24_update(rf);
+	rf->cmd = 0;
+	rf->idx = 0xFF;		/* Command byte expected */
+}
+
+
+static uint8_t nrf24_xfer(spi_sim_device_t *dev, uint8_t mosi)
+{
+	spi_sim_nrf24_t *rf = (spi_sim_nrf24_t *)dev;
+	uint8_t cmd = rf->cmd;
+	uint8_t miso = 0x00;
+
+	if(rf->idx == 0xFF) {
+		/* Command byte : STATUS is shifted out */
+		miso = nrf24_status(rf);
+		rf->cmd = mosi;
+		rf->idx = 0;
+		switch(mosi) {
+		case NRF_FLUSH_TX:
+			if(!rf->tx_busy) {
+				rf->tx_count = 0;
+				rf->tx_reuse = 0;
+			}
+			break;
+		case NRF_FLUSH_RX:
+			rf->rx_count = 0;
+			break;
+		case NRF_REUSE_TX_PL:
+			rf->tx_reuse = 1;
+			break;
+		case NRF_W_TX_PAYLOAD:
+		case NRF_W_TX_PAYLOAD_NOACK:
+			memset(&rf->wr, 0, sizeof(rf->wr));
+			rf->wr.noack = (mosi == NRF_W_TX_PAYLOAD_NOACK);
+			break;
+		}
+		return miso;
+	}
+	if(cmd < NRF_W_REGISTER) {
+		miso = nrf24_read_reg(rf, cmd & 0x1F);
+	}
+	else if(cmd < NRF_ACTIVATE) {
+		nrf24_write_reg(rf, cmd & 0x1F, mosi);
+	}
+	else if(cmd == NRF_R_RX_PL_WID) {
+		miso = rf->rx_count ? rf->rx_fifo[0].len : 0;
+	}
+	else if(cmd == NRF_R_RX_PAYLOAD) {
+		if(rf->rx_count && (rf->idx < rf->rx_fifo[0].len)) {
+			miso = rf->rx_fifo[0].data[rf->idx];
+		}
+	}
+	else if((cmd == NRF_W_TX_PAYLOAD) || (cmd == NRF_W_TX_PAYLOAD_NOACK)) {
+		if(rf->wr.len < 32) {
+			rf->wr.data[rf->wr.len++] = mosi;
+		}
+	}
+	if(rf->idx < 0xFE) {
+		rf->idx++;
+	}
+	return miso;
+}
+
+
+static void nrf24_deselect(spi_sim_device_t *dev)
+{
+	spi_sim_nrf24_t *rf = (spi_sim_nrf24_t *)dev;
+
+	if((rf->cmd == NRF_R_RX_PAYLOAD) && rf->idx && (rf->idx != 0xFF) && rf->rx_count) {
+		/* Payload read : removed from the FIFO */
+		rf->rx_count--;
+		memmove(&rf->rx_fifo[0], &rf->rx_fifo[1], rf->rx_count * sizeof(rf->rx_fifo[0]));
+	}
+	if(((rf->cmd == NRF_W_TX_PAYLOAD) || (rf->cmd == NRF_W_TX_PAYLOAD_NOACK)) && (rf->idx != 0xFF)
+	   && rf->wr.len && (rf->tx_count < 3)) {
+		rf->tx_fifo[rf->tx_count++] = rf->wr;
+		rf->tx_reuse = 0;
+	}
+	rf->cmd = 0;
+	rf->idx = 0xFF;
+	nrf24_update(rf);
+}
+
+
+void spi_sim_nrf24_init(spi_sim_nrf24_t *rf, volatile uint8_t *cs_port, uint8_t cs_bit,
+						volatile uint8_t *ce_port, uint8_t ce_bit)
+{
+	static const uint8_t reset[0x20] = {
+		0x08, 0x3F, 0x03, 0x03, 0x03, 0x02, 0x0E, 0x0E, 0x00, 0x00, 0x00, 0x00, 0xC3, 0xC4, 0xC5, 0xC6,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+	spi_sim_nrf24_t **p;
+
+	for(p = &_nrf24_list; *p; p = &(*p)->next) {
+		if(*p == rf) {
+			*p = rf->next;
+			break;
+		}
+	}
+	memset(rf, 0, sizeof(*rf));
+	memcpy(rf->regs, reset, sizeof(rf->regs));
+	memset(rf->rx_addr_p0, 0xE7, 5);
+	memset(rf->rx_addr_p1, 0xC2, 5);
+	memset(rf->tx_addr, 0xE7, 5);
+	rf->dev.cs_port = cs_port;
+	rf->dev.cs_mask = (1 << cs_bit);
+	rf->dev.select = nrf24_select;
+	rf->dev.xfer = nrf24_xfer;
+	rf->dev.deselect = nrf24_deselect;
+	rf->ce_port = ce_port;
+	rf->ce_mask = (1 << ce_bit);
+	rf->link = 1;
+	rf->idx = 0xFF;
+	rf->next = _nrf24_list;
+	_nrf24_list = rf;
+	sim_add_peripheral(&_nrf24_periph);
+	spi_sim_attach(&rf->dev);
+}
+
+
+uint8_t spi_sim_nrf24_receive(spi_sim_nrf24_t *rf, uint8_t pipe, const uint8_t *data, uint8_t len)
+{
+	uint8_t config = rf->regs[NRF_CONFIG];
+	spi_sim_nrf24_packet_t *pkt;
+
+	nrf24_update(rf);
+	if(!(config & NRF_PWR_UP) || !(config & NRF_PRIM_RX) || !(*rf->ce_port & rf->ce_mask)
+	   || (pipe > 5) || !(rf->regs[NRF_EN_RXADDR] & (1 << pipe)) || (rf->rx_count == 3) || (len > 32)) {
+		return 0;
+	}
+	/* Without dynamic payload length, the pipe takes RX_PW_Px bytes: a packet of another width is not received */
+	if(!((rf->regs[NRF_FEATURE] & NRF_EN_DPL) && (rf->regs[NRF_DYNPD] & (1 << pipe)))
+	   && (len != rf->regs[NRF_RX_PW_P0 + pipe])) {
+		return 0;
+	}
+	pkt = &rf->rx_fifo[rf->rx_count++];
+	pkt->len = len;
+	pkt->pipe = pipe;
+	pkt->noack = 0;
+	memcpy(pkt->data, data, len);
+	rf->regs[NRF_STATUS] |= NRF_RX_DR;
+	rf->packets_rx++;
+	nrf24_irq_out(rf);
+	return 1;
+}
+
+
+uint8_t spi_sim_nrf24_irq_pin(spi_sim_nrf24_t *rf)
+{
+	/* CONFIG bits 6:4 mask the interrupt flags of STATUS */
+	return !(rf->regs[NRF_STATUS] & NRF_IRQ_FLAGS & ~rf->regs[NRF_CONFIG]);
+}
+
+
+/**************************** Pin-level slave ********************************/
+
+static spi_sim_pins_t	*_pins_list;
+
+static void pins_poll(void);
+
+static sim_peripheral_t	_pins_periph = { pins_poll, 0, 0, 0 };
+
+
+static void pins_miso(spi_sim_pins_t *s)
+{
+	if(s->data & 0x80) {
+		*s->pin |= s->miso_mask;
+	}
+	else {
+		*s->pin &= ~s->miso_mask;
+	}
+}
+
+
+/* Handles CS and the SCK edge since the last poll */
+static void pins_update(spi_sim_pins_t *s)
+{
+	uint8_t sck = (*s->port & s->sck_mask) != 0;
+	uint8_t leading;
+
+	if(*s->port & s->cs_mask) {
+		if(s->selected) {
+			s->selected = 0;
+			*s->pin |= s->miso_mask;		/* MISO released: pull-up */
+		}
+		return;
+	}
+	if(!s->selected) {
+		/* CPHA = 0: first bit out on CS LOW */
+		s->selected = 1;
+		s->sck = sck;
+		pins_miso(s);
+		return;
+	}
+	if(sck == s->sck) {
+		return;
+	}
+	s->sck = sck;
+	leading = (sck != ((s->mode >> 1) & 1));		/* From the idle level (CPOL) */
+	if(leading == !(s->mode & 1)) {
+		/* Sampling edge: leading for CPHA = 0, trailing for CPHA = 1 */
+		s->data = (s->data << 1) | ((*s->port & s->mosi_mask) != 0);
+		s->bits++;
+	}
+	else {
+		pins_miso(s);
+	}
+}
+
+
+static void pins_poll(void)
+{
+	spi_sim_pins_t *s;
+
+	for(s = _pins_list; s; s = s->next) {
+		pins_update(s);
+	}
+}
+
+
+void spi_sim_pins_init(spi_sim_pins_t *slave, volatile uint8_t *port, volatile uint8_t *pin, uint8_t cs_bit,
+					   uint8_t sck_bit, uint8_t mosi_bit, uint8_t miso_bit, uint8_t mode)
+{
+	spi_sim_pins_t **p;
+
+	for(p = &_pins_list; *p; p = &(*p)->next) {
+		if(*p == slave) {
+			*p = slave->next;
+			break;
+		}
+	}
+	memset(slave, 0, sizeof(*slave));
+	slave->port = port;
+	slave->pin = pin;
+	slave->cs_mask = (1 << cs_bit);
+	slave->sck_mask = (1 << sck_bit);
+	slave->mosi_mask = (1 << mosi_bit);
+	slave->miso_mask = (1 << miso_bit);
+	slave->mode = mode & 3;
+	slave->next = _pins_list;
+	_pins_list = slave;
+	sim_add_peripheral(&_pins_periph);
+}
@@ -0,0 +1,120 @@
+/*
+ *	spi_sim_devices.h
+ *
+ *	Models of the SPI devices used by the drivers in this repository, for the simulated SPI bus (spi_sim.h)
+ *
+ *	nRF24L01+ : register map, commands, 3-level TX/RX FIFOs and the PTX air timing (settling, packet and ACK
+ *	air time, auto-retransmit). Packets without ACK follow each other in TX mode while CE is HIGH. The CE pin is sampled whenever the simulated time advances, so a pulse made
+ *	with _delay_us() starts a transmission as on the real chip. Packets go to a peer through a callback, and
+ *	packets from the peer are injected with spi_sim_nrf24_receive(). The IRQ pin can drive an external interrupt
+ *	pin (see sim.h).
+ *
+ *	Pin-level slave : an 8-bit shift register on port pins, for the bit-bang backend built on the host
+ *	(SPI_BACKEND_SOFT). It is not on the simulated bus of spi_sim.c.
+ */
+
+#ifndef SPI_SIM_DEVICES_H
+#define SPI_SIM_DEVICES_H
+
+#include <stdint.h>
+#include "spi_sim.h"
+
+/* A packet in a FIFO of the nRF24 model */
+typedef struct {
+	uint8_t		len;
+	uint8_t		pipe;			/* RX : pipe of the packet */
+	uint8_t		noack;			/* TX : written with W_TX_PAYLOAD_NOACK */
+	uint8_t		data[32];
+} spi_sim_nrf24_packet_t;
+
+/* nRF24L01+ radio */
+typedef struct spi_sim_nrf24 {
+	spi_sim_device_t		dev;
+	uint8_t					regs[0x20];			/* Single byte registers (address registers below) */
+	uint8_t					rx_addr_p0[5];
+	uint8_t					rx_addr_p1[5];
+	uint8_t					tx_addr[5];
+	spi_sim_nrf24_packet_t	tx_fifo[3];
+	uint8_t					tx_count;
+	uint8_t					tx_reuse;
+	spi_sim_nrf24_packet_t	rx_fifo[3];
+	uint8_t					rx_count;
+	volatile uint8_t		*ce_port;			/* PORT register of the CE pin */
+	uint8_t					ce_mask;
+	volatile uint8_t		*irq_port;			/* PIN register driven by the IRQ pin (eg: &PIND, for INT1 on PD3),
+												 * 0 if not connected. Set by the test program */
+	uint8_t					irq_mask;
+	/* Link to the peer, set by the test program */
+	uint8_t					link;				/* 1: transmitted packets reach the peer (and are ACKed) */
+	uint8_t					lose;				/* Number of next transmissions lost even if link is 1 */
+	void					(*on_tx)(struct spi_sim_nrf24 *rf, const spi_sim_nrf24_packet_t *pkt);	/* Packet delivered */
+	/* Used by the model */
+	uint8_t					cmd;				/* Command of the transaction */
+	uint8_t					idx;				/* Data byte index in the transaction */
+	spi_sim_nrf24_packet_t	wr;					/* Payload being written */
+	uint8_t					ce_seen;			/* CE seen HIGH since last check */
+	uint8_t					tx_busy;			/* Transmission in progress */
+	uint8_t					tx_ok;				/* Transmission in progress ends with TX_DS (else MAX_RT) */
+	uint8_t					tx_delivered;		/* Packet in progress reaches the peer */
+	uint8_t					tx_attempts;
+	uint64_t				tx_end;				/* Time (ns) of the end of the transmission in progress */
+	uint64_t				tx_mode_start;		/* Time the radio entered TX mode */
+	uint8_t					tx_noack;			/* Last packet was sent without ACK */
+	struct spi_sim_nrf24	*next;
+	/* Counters */
+	uint32_t				packets_tx;			/* Packets delivered to the peer */
+	uint32_t				packets_rx;			/* Packets received into the RX FIFO */
+	uint32_t				attempts;			/* Transmissions, including retransmissions */
+	uint32_t				max_rt;				/* Packets failed after all retransmissions */
+	uint64_t				air_ns;				/* Time spent transmitting (packets and ACKs) */
+	uint64_t				tx_mode_max_ns;		/* Longest continuous time in TX mode (4 ms max for nRF24L01+) */
+} spi_sim_nrf24_t;
+
+
+/* Initializes the model to power-on reset state and attaches it to the bus
+ *	cs_port, cs_bit - CSN pin (PORT register and bit)
+ *	ce_port, ce_bit - CE pin
+ *	The link is up (link = 1) and no peer callback is set.
+ */
+void spi_sim_nrf24_init(spi_sim_nrf24_t *rf, volatile uint8_t *cs_port, uint8_t cs_bit,
+						volatile uint8_t *ce_port, uint8_t ce_bit);
+
+
+/* Delivers a packet from the peer. Returns 1 if it was stored in the RX FIFO (PRX mode, powered up, CE HIGH,
+ * pipe enabled, len equal to RX_PW_Px if the pipe has no dynamic payload length, FIFO not full), 0 if it was missed.
+ */
+uint8_t spi_sim_nrf24_receive(spi_sim_nrf24_t *rf, uint8_t pipe, const uint8_t *data, uint8_t len);
+
+
+/* Level of the IRQ pin: 0 when an unmasked interrupt flag (RX_DR, TX_DS, MAX_RT) is set */
+uint8_t spi_sim_nrf24_irq_pin(spi_sim_nrf24_t *rf);
+
+
+/* SPI slave on port pins: a shift register clocked by the SCK edges of the given mode. MISO is its MSB, MOSI is
+ * shifted in at the LSB, so each byte read by the master is the previous content of the register (the byte
+ * sent before, or data for the first one). The pins are sampled when the simulated time advances: the master
+ * must wait between SCK edges (SPI_BACKEND_SOFT at SPI_CLKDIV_8 and slower, which have a half period delay).
+ */
+typedef struct spi_sim_pins {
+	volatile uint8_t		*port;				/* PORT register of CS, SCK and MOSI */
+	volatile uint8_t		*pin;				/* PIN register of MISO */
+	uint8_t					cs_mask;
+	uint8_t					sck_mask;
+	uint8_t					mosi_mask;
+	uint8_t					miso_mask;
+	uint8_t					mode;				/* SPI mode 0 - 3 */
+	uint8_t					data;				/* Shift register */
+	/* Used by the model */
+	uint8_t					selected;
+	uint8_t					sck;				/* SCK level last seen */
+	struct spi_sim_pins		*next;
+	/* Counters */
+	uint32_t				bits;				/* Bits shifted in */
+} spi_sim_pins_t;
+
+
+/* Initializes the slave (shift register 0) and connects it to the pins. CS is on the port of SCK and MOSI */
+void spi_sim_pins_init(spi_sim_pins_t *slave, volatile uint8_t *port, volatile uint8_t *pin, uint8_t cs_bit,
+					   uint8_t sck_bit, uint8_t mosi_bit, uint8_t miso_bit, uint8_t mode);
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ *	spi_test.c
+ *
+ *	Tests of avr_spi.c on the simulated bus (make test)
+ *
+ *	Built for each backend that runs on the host: spi_test with the simulated bus (SPI_BACKEND_HOST),
+ *	spi_test_usart with SPI_BACKEND_USART (register values only, the USART is not modelled), spi_test_soft with
+ *	SPI_BACKEND_SOFT against the pin-level slave of spi_sim_devices.h. Each test starts
+ *	with an empty bus. Interrupt handlers are simulated by plain functions run with sim_interrupt(). Failed
+ *	checks are printed, and the program exits with 1 if any check failed.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim.h"
+#include "spi_sim.h"
+#include "spi_sim_devices.h"
+#include "avr_spi.h"
+
+#define CHECK(cond)		do { \
+							if(!(cond)) { \
+								printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+								_failures++; \
+							} \
+						} while(0)
+
+static unsigned				_failures;
+
+static spi_device_t			_dev;
+static unsigned				_runs_a;
+static unsigned				_runs_b;
+static char					_order[4];
+static uint8_t				_order_len;
+
+
+/* Empty bus, simulated time 0 */
+static void test_setup(void)
+{
+	sim_reset();
+	spi_sim_init();
+	SPI_Init(SPI_MODE0, SPI_CLKDIV_4);
+	SPI_Device_Init(&_dev, SPI_MODE0, SPI_CLKDIV_4, &PORTB, &DDRB, PB0);
+	sei();
+	_runs_a = _runs_b = 0;
+	_order_len = 0;
+}
+
+
+static void deferred_a(void)
+{
+	_runs_a++;
+	_order[_order_len++] = 'a';
+}
+
+static void deferred_b(void)
+{
+	_runs_b++;
+	_order[_order_len++] = 'b';
+}
+
+static spi_deferred_t		_entry_a = { .func = deferred_a };
+static spi_deferred_t		_entry_b = { .func = deferred_b };
+
+/* Interrupt handlers using the bus: hand over their work when they find it busy */
+static void isr_a(void)
+{
+	if(SPI_Bus_Busy()) {
+		SPI_Defer(&_entry_a);
+		return;
+	}
+	deferred_a();
+}
+
+static void isr_b(void)
+{
+	if(SPI_Bus_Busy()) {
+		SPI_Defer(&_entry_b);
+		return;
+	}
+	deferred_b();
+}
+
+
+/* Deferred once, however many times the handler ran, and run by SPI_Release() */
+static void test_defer(void)
+{
+	SPI_Acquire(&_dev);
+	CHECK(SPI_Bus_Busy());
+	CHECK(sim_interrupt(isr_a));
+	CHECK(sim_interrupt(isr_a));
+	CHECK(_runs_a == 0);
+	SPI_Release(&_dev);
+	CHECK(!SPI_Bus_Busy());
+	CHECK(_runs_a == 1);
+
+	/* Not queued any more */
+	SPI_Acquire(&_dev);
+	SPI_Release(&_dev);
+	CHECK(_runs_a == 1);
+
+	/* Bus free: not deferred */
+	CHECK(sim_interrupt(isr_a));
+	CHECK(_runs_a == 2);
+
+	/* Queued again once run */
+	SPI_Acquire(&_dev);
+	CHECK(sim_interrupt(isr_a));
+	SPI_Release(&_dev);
+	CHECK(_runs_a == 3);
+}
+
+
+/* Run in the order of SPI_Defer() */
+static void test_defer_order(void)
+{
+	SPI_Acquire(&_dev);
+	CHECK(sim_interrupt(isr_b));
+	CHECK(sim_interrupt(isr_a));
+	CHECK(sim_interrupt(isr_b));
+	SPI_Release(&_dev);
+	CHECK((_runs_a == 1) && (_runs_b == 1));
+	CHECK((_order_len == 2) && !memcmp(_order, "ba", 2));
+}
+
+
+#if SPI_BACKEND == SPI_BACKEND_USART
+/* UBRR0 of each SPI_CLKDIV_t: SCK = F_CPU / (2 * (UBRR0 + 1)) */
+static void test_usart_rate(void)
+{
+	static const uint8_t dividers[] = { 4, 16, 64, 128, 2, 8, 32 };	/* In SPI_CLKDIV_t order */
+	spi_device_t dev;
+	uint8_t div;
+	uint8_t mode;
+
+	for(div = SPI_CLKDIV_4; div <= SPI_CLKDIV_32; div++) {
+		SPI_Init(SPI_MODE0, div);
+		CHECK((F_CPU / (2 * (UBRR0 + 1UL))) == (F_CPU / dividers[div]));
+		SPI_Device_Init(&dev, SPI_MODE0, div, &PORTB, &DDRB, PB0);
+		CHECK(dev.rate == UBRR0);
+	}
+	CHECK(UCSR0B == (_BV(RXEN0) | _BV(TXEN0)));
+	CHECK((DDRD & (_BV(PD4) | _BV(PD1))) == (_BV(PD4) | _BV(PD1)));	/* XCK as output: master */
+
+	/* Mode: CPHA in UCPHA0, CPOL in UCPOL0, MSB first */
+	for(mode = SPI_MODE0; mode <= SPI_MODE3; mode++) {
+		SPI_Init(mode, SPI_CLKDIV_4);
+		CHECK(UCSR0C == (_BV(UMSEL01) | _BV(UMSEL00) | ((mode & 1) << UCPHA0) | ((mode >> 1) << UCPOL0)));
+	}
+
+	/* Registers of the device set by SPI_Acquire() */
+	SPI_Init(SPI_MODE0, SPI_CLKDIV_4);
+	SPI_Device_Init(&dev, SPI_MODE3, SPI_CLKDIV_128, &PORTB, &DDRB, PB0);
+	SPI_Acquire(&dev);
+	CHECK(UBRR0 == 63);
+	CHECK(UCSR0C == (_BV(UMSEL01) | _BV(UMSEL00) | _BV(UCPHA0) | _BV(UCPOL0)));
+	CHECK(!(PORTB & _BV(PB0)));
+	SPI_Release(&dev);
+	CHECK(PORTB & _BV(PB0));
+}
+#endif
+
+
+#if SPI_BACKEND == SPI_BACKEND_HOST
+/* Mode and clock rate programmed by SPI_Acquire(), also when the device is set again */
+static void test_device(void)
+{
+	spi_device_t other;
+
+	SPI_Device_Init(&other, SPI_MODE0, SPI_CLKDIV_4, &PORTB, &DDRB, PB1);
+	SPI_Device_Init(&_dev, SPI_MODE3, SPI_CLKDIV_64, &PORTB, &DDRB, PB0);
+	SPI_Acquire(&_dev);
+	CHECK((SPCR & (_BV(CPOL) | _BV(CPHA) | _BV(SPR1) | _BV(SPR0))) == (_BV(CPOL) | _BV(CPHA) | _BV(SPR1)));
+	SPI_Release(&_dev);
+	SPI_Device_Init(&_dev, SPI_MODE1, SPI_CLKDIV_16, &PORTB, &DDRB, PB0);
+	SPI_Acquire(&_dev);
+	CHECK((SPCR & (_BV(CPOL) | _BV(CPHA) | _BV(SPR1) | _BV(SPR0))) == (_BV(CPHA) | _BV(SPR0)));
+	SPI_Release(&_dev);
+	SPI_Acquire(&other);
+	CHECK((SPCR & (_BV(CPOL) | _BV(CPHA) | _BV(SPR1) | _BV(SPR0))) == 0);
+	SPI_Release(&other);
+}
+#endif
+
+
+#if SPI_BACKEND == SPI_BACKEND_SOFT
+static spi_sim_pins_t		_slave;
+
+/* Exchanges tx with the slave in the given modes, at the given clock rate */
+static void soft_exchange(uint8_t master_mode, uint8_t slave_mode, SPI_CLKDIV_t clk_div,
+						  const uint8_t *tx, uint8_t *rx, uint8_t length)
+{
+	spi_sim_pins_init(&_slave, &SPI_PORT, &SPI_PIN, PB0, SCK_BIT, MOSI_BIT, MISO_BIT, slave_mode);
+	_slave.data = 0x5A;
+	SPI_Device_Init(&_dev, master_mode, clk_div, &PORTB, &DDRB, PB0);
+	SPI_Acquire(&_dev);
+	SPI_TransferBuf(tx, rx, length);
+	SPI_Release(&_dev);
+}
+
+
+/* Bit-bang backend in the 4 modes: the slave sends back the previous byte */
+static void test_soft_loopback(void)
+{
+	static const uint8_t tx[] = { 0xA5, 0x3C, 0x01, 0x80, 0xFF, 0x00, 0x96 };
+	uint8_t rx[sizeof(tx)];
+	uint8_t mode;
+	uint8_t i;
+
+	for(mode = SPI_MODE0; mode <= SPI_MODE3; mode++) {
+		memset(rx, 0, sizeof(rx));
+		soft_exchange(mode, mode, SPI_CLKDIV_16, tx, rx, sizeof(tx));
+		CHECK(rx[0] == 0x5A);
+		for(i = 1; i < sizeof(tx); i++) {
+			CHECK(rx[i] == tx[i - 1]);
+		}
+		CHECK(_slave.data == tx[sizeof(tx) - 1]);
+		CHECK(_slave.bits == 8 * sizeof(tx));
+		CHECK(((SPI_PORT >> SCK_BIT) & 1) == (mode >> 1));		/* SCK back to idle level (CPOL) */
+
+		/* Shortest delay */
+		soft_exchange(mode, mode, SPI_CLKDIV_8, tx, rx, 2);
+		CHECK((rx[0] == 0x5A) && (rx[1] == tx[0]));
+		CHECK(SPI_TxRx(0) == 0xFF);		/* Not selected: pull-up */
+	}
+
+	/* The slave sees the other clock phase */
+	soft_exchange(SPI_MODE0, SPI_MODE1, SPI_CLKDIV_16, tx, rx, sizeof(tx));
+	CHECK(rx[1] != tx[0]);
+	soft_exchange(SPI_MODE2, SPI_MODE0, SPI_CLKDIV_16, tx, rx, sizeof(tx));
+	CHECK(rx[1] != tx[0]);
+}
+#endif
+
+
+static const struct {
+	const char	*name;
+	void		(*run)(void);
+} _tests[] = {
+	{ "defer", test_defer },
+	{ "defer order", test_defer_order },
+#if SPI_BACKEND == SPI_BACKEND_HOST
+	{ "device", test_device },
+#endif
+#if SPI_BACKEND == SPI_BACKEND_USART
+	{ "usart rate", test_usart_rate },
+#endif
+#if SPI_BACKEND == SPI_BACKEND_SOFT
+	{ "soft loopback", test_soft_loopback },
+#endif
+};
+
+
+int main(void)
+{
+	unsigned i;
+	unsigned failures;
+
+	for(i = 0; i < sizeof(_tests) / sizeof(_tests[0]); i++) {
+		failures = _failures;
+		test_setup();
+		_tests[i].run();
+		printf("%-16s %s\n", _tests[i].name, (_failures == failures) ? "ok" : "FAILED");
+	}
+	return _failures ? 1 : 0;
+}
@@ -0,0 +1,460 @@
+/*
+ *	twi_sim.c
+ *
+ *	Simulated TWI bus for the host build of avr_twi.c
+ *
+ *	TWCR holds both the command written by the firmware and the TWINT flag set by the hardware. To tell
+ *	them apart, the flag is raised together with the reserved bit 1 of TWCR: any later assignment of TWCR
+ *	by the firmware clears it, which marks a new command.
+ *
+ *	The external master (twi_sim_host_transfer()) raises the slave states the same way, and holds SCL low
+ *	while TWINT is set, as the hardware stretches the clock until the interrupt has responded.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/twi.h>
+#include "sim.h"
+#include "twi_sim.h"
+
+#undef TWCR		/* The model accesses the register itself (see util/twi.h) */
+
+#define TWCR_MARK				_BV(1)		/* Reserved bit of TWCR, set with TWINT by the simulated hardware */
+
+/* Command in progress */
+enum {
+	OP_NONE = 0,
+	OP_START,
+	OP_ADDR,
+	OP_WRITE,
+	OP_READ,
+	OP_HANG					/* SCL held low by a device */
+};
+
+/* Next byte expected on the bus */
+enum {
+	PHASE_NONE = 0,			/* After NACK, only START/STOP */
+	PHASE_ADDR,				/* SLA+R/W after START */
+	PHASE_MT,				/* Data from master */
+	PHASE_MR				/* Data to master */
+};
+
+ISR(TWI_vect);
+
+static twi_sim_device_t		*_devices;
+static twi_sim_device_t		*_dev;			/* Addressed device */
+static uint8_t				_owned;			/* Master holds the bus (START sent) */
+static uint8_t				_phase;
+static uint8_t				_op;
+static uint8_t				_op_ack;		/* TWEA of read command */
+static uint64_t				_op_start;
+static uint64_t				_op_end;
+static uint64_t				_bus_free;		/* Time after the last STOP */
+static uint8_t				_flag;			/* TWINT raised */
+static uint8_t				_irq_pending;	/* Interrupt to be run for the raised flag */
+static uint8_t				_from_isr;		/* Command written by the interrupt handler */
+static uint8_t				_arb_lose;
+static twi_sim_stats_t		_stats;
+
+static void twi_sim_poll(void);
+static uint64_t twi_sim_next_event(void);
+static void twi_sim_event(void);
+
+static sim_peripheral_t		_twi_periph = { twi_sim_poll, twi_sim_next_event, twi_sim_event, 0 };
+
+
+uint32_t twi_sim_scl_hz(void)
+{
+	uint32_t div = 16 + 2 * (uint32_t)TWBR * (1 << (2 * (TWSR & 0x3)));
+
+	return F_CPU / div;
+}
+
+
+/* Duration of one SCL period in ns */
+static uint64_t twi_sim_bit_ns(void)
+{
+	return 1000000000ULL / twi_sim_scl_hz();
+}
+
+
+/* Releases the bus and the addressed device */
+static void twi_sim_release(void)
+{
+	if(_dev && _dev->stop) {
+		_dev->stop(_dev);
+	}
+	_dev = 0;
+	_owned = 0;
+	_phase = PHASE_NONE;
+}
+
+
+/* Sets the status code and raises TWINT */
+static void twi_sim_raise(uint8_t status)
+{
+	TWSR = (TWSR & 0x3) | status;
+	TWCR |= _BV(TWINT)|TWCR_MARK;
+	_flag = 1;
+	_irq_pending = 1;
+}
+
+
+/* Starts the command written to TWCR */
+static void twi_sim_command(void)
+{
+	uint8_t cr = TWCR;
+	uint64_t now = sim_now_ns();
+	uint64_t bit_ns = twi_sim_bit_ns();
+
+	TWCR = cr & ~_BV(TWINT);	/* Flag cleared by writing one */
+	if(_from_isr) {
+		now += (TWI_SIM_ISR_CYCLES * 1000000000ULL) / F_CPU;
+		_from_isr = 0;
+	}
+	if(cr & _BV(TWSTO)) {
+		if(_owned) {
+			_stats.stops++;
+			twi_sim_release();
+			_bus_free = now + bit_ns;
+		}
+		TWCR &= ~_BV(TWSTO);	/* Cleared by hardware when STOP is sent */
+		if(!(cr & _BV(TWSTA))) {
+			return;
+		}
+	}
+	if(cr & _BV(TWSTA)) {
+		_op = OP_START;
+		_op_start = (now > _bus_free) ? now : _bus_free;
+		_op_end = _op_start + bit_ns;
+		return;
+	}
+	if(!_owned || (_phase == PHASE_NONE)) {
+		return;
+	}
+	_op_start = now;
+	_op_end = now + 9 * bit_ns;
+	if(_phase == PHASE_ADDR) {
+		_op = OP_ADDR;
+	}
+	else if(_phase == PHASE_MT) {
+		_op = OP_WRITE;
+	}
+	else {
+		_op = OP_READ;
+		_op_ack = (cr & _BV(TWEA)) != 0;
+	}
+}
+
+
+/* TWCR accessed by the firmware : a pending STOP command is executed now. A STOP that can't be sent
+ * (module disabled) is dropped
+ */
+volatile uint8_t *twi_sim_twcr(void)
+{
+	if(TWCR & _BV(TWSTO)) {
+		if((TWCR & _BV(TWEN)) && (_op == OP_NONE) && (TWCR & _BV(TWINT)) && !(TWCR & TWCR_MARK)) {
+			_flag = 0;
+			_irq_pending = 0;
+			twi_sim_command();
+		}
+		TWCR &= ~_BV(TWSTO);
+	}
+	return &TWCR;
+}
+
+
+/* Handles TWCR writes and runs the interrupt */
+static void twi_sim_poll(void)
+{
+	for(;;) {
+		if(!(TWCR & _BV(TWEN))) {
+			/* Module disabled : pins are released */
+			if(_owned || _op || _flag) {
+				twi_sim_release();
+				_op = OP_NONE;
+				_flag = 0;
+				_irq_pending = 0;
+			}
+			return;
+		}
+		if(_op != OP_NONE) {
+			return;
+		}
+		if(_flag && (TWCR & TWCR_MARK)) {
+			/* Not written since raised */
+			if(_irq_pending && (TWCR & _BV(TWIE)) && sim_interrupt(TWI_vect)) {
+				_irq_pending = 0;
+				_from_isr = 1;
+				_stats.interrupts++;
+				continue;
+			}
+			_from_isr = 0;
+			return;
+		}
+		if(!(TWCR & _BV(TWINT))) {
+			if(_flag) {
+				TWCR |= _BV(TWINT)|TWCR_MARK;	/* Written without clearing the flag */
+			}
+			_from_isr = 0;
+			return;
+		}
+		_flag = 0;
+		_irq_pending = 0;
+		twi_sim_command();
+		if(_op == OP_NONE) {
+			return;
+		}
+	}
+}
+
+
+static uint64_t twi_sim_next_event(void)
+{
+	if((_op == OP_NONE) || (_op == OP_HANG)) {
+		return UINT64_MAX;
+	}
+	return _op_end;
+}
+
+
+/* Finds the device for an address */
+static twi_sim_device_t *twi_sim_find(uint8_t addr)
+{
+	twi_sim_device_t *dev;
+
+	for(dev = _devices; dev; dev = dev->next) {
+		if(dev->addr == addr) {
+			return dev;
+		}
+	}
+	return 0;
+}
+
+
+/* End of command : set status and raise TWINT */
+static void twi_sim_event(void)
+{
+	twi_sim_device_t *dev;
+	uint8_t status = TW_NO_INFO;
+	uint8_t read;
+	uint8_t ack;
+
+	switch(_op) {
+		case OP_START:
+			status = _owned ? TW_REP_START : TW_START;
+			if(_owned) {
+				_stats.rep_starts++;
+			}
+			_stats.starts++;
+			_owned = 1;
+			_dev = 0;
+			_phase = PHASE_ADDR;
+			break;
+
+		case OP_ADDR:
+			read = TWDR & 1;
+			if(_arb_lose) {
+				_arb_lose--;
+				_stats.arb_lost++;
+				_owned = 0;
+				_phase = PHASE_NONE;
+				status = TW_MT_ARB_LOST;
+				break;
+			}
+			dev = twi_sim_find(TWDR >> 1);
+			if(dev && dev->hang) {
+				dev->hang = 0;
+				_dev = dev;
+				_op = OP_HANG;
+				return;
+			}
+			if(dev && dev->start(dev, read)) {
+				_dev = dev;
+				_phase = read ? PHASE_MR : PHASE_MT;
+				status = read ? TW_MR_SLA_ACK : TW_MT_SLA_ACK;
+			}
+			else {
+				_stats.addr_nacks++;
+				_phase = PHASE_NONE;
+				status = read ? TW_MR_SLA_NACK : TW_MT_SLA_NACK;
+			}
+			break;
+
+		case OP_WRITE:
+			ack = _dev->write(_dev, TWDR);
+			_stats.bytes_tx++;
+			if(!ack) {
+				_stats.data_nacks++;
+				_phase = PHASE_NONE;
+			}
+			status = ack ? TW_MT_DATA_ACK : TW_MT_DATA_NACK;
+			break;
+
+		case OP_READ:
+			TWDR = _dev->read(_dev, _op_ack);
+			_stats.bytes_rx++;
+			if(!_op_ack) {
+				_phase = PHASE_NONE;
+			}
+			status = _op_ack ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+			break;
+	}
+	_stats.busy_ns += _op_end - _op_start;
+	_op = OP_NONE;
+	twi_sim_raise(status);
+}
+
+
+void twi_sim_init(void)
+{
+	_devices = 0;
+	_dev = 0;
+	_owned = 0;
+	_phase = PHASE_NONE;
+	_op = OP_NONE;
+	_flag = 0;
+	_irq_pending = 0;
+	_from_isr = 0;
+	_arb_lose = 0;
+	_bus_free = 0;
+	twi_sim_stats_reset();
+	sim_add_peripheral(&_twi_periph);
+}
+
+
+void twi_sim_attach(twi_sim_device_t *dev)
+{
+	dev->next = _devices;
+	_devices = dev;
+}
+
+
+void twi_sim_detach(twi_sim_device_t *dev)
+{
+	twi_sim_device_t **link;
+
+	for(link = &_devices; *link; link = &(*link)->next) {
+		if(*link == dev) {
+			*link = dev->next;
+			break;
+		}
+	}
+}
+
+
+void twi_sim_lose_arbitration(uint8_t count)
+{
+	_arb_lose = count;
+}
+
+
+void twi_sim_stats_get(twi_sim_stats_t *stats)
+{
+	*stats = _stats;
+}
+
+
+void twi_sim_stats_reset(void)
+{
+	twi_sim_stats_t zero = {0};
+
+	_stats = zero;
+}
+
+
+/* External master : bus event after 'bits' SCL periods, then SCL is held while TWINT is set
+ *	Returns TWCR written by the AVR in response, 0 if it did not respond (interrupts disabled)
+ */
+static uint8_t twi_sim_host_event(uint8_t status, uint8_t bits)
+{
+	uint64_t bit_ns = twi_sim_bit_ns();
+	uint16_t i;
+
+	sim_advance_ns(bits * bit_ns);
+	twi_sim_raise(status);
+	for(i = 0; _flag && (i < TWI_SIM_HOST_STRETCH_BITS); i++) {
+		sim_advance_ns(bit_ns);
+	}
+	if(_flag) {
+		_flag = 0;
+		_irq_pending = 0;
+		TWCR &= ~(_BV(TWINT)|TWCR_MARK);
+		return 0;
+	}
+	return TWCR;
+}
+
+
+/* Own address recognized : module enabled with TWEA and idle as master */
+static uint8_t twi_sim_host_addressed(uint8_t addr)
+{
+	return (TWCR & _BV(TWEN)) && (TWCR & _BV(TWEA)) && !_owned && (_op == OP_NONE) && !_flag && ((TWAR >> 1) == addr);
+}
+
+
+int twi_sim_host_transfer(uint8_t addr, const uint8_t *tx, uint8_t tx_count, uint8_t *rx, uint8_t rx_count)
+{
+	uint8_t cr;
+	uint8_t i;
+	int acked = 0;
+
+	if(tx_count || !rx_count) {
+		if(!twi_sim_host_addressed(addr)) {
+			sim_advance_ns(9 * twi_sim_bit_ns());
+			return -1;
+		}
+		if(!(cr = twi_sim_host_event(TW_SR_SLA_ACK, 10))) {
+			return -1;
+		}
+		for(i = 0; i < tx_count; i++) {
+			TWDR = tx[i];
+			if(!(cr & _BV(TWEA))) {
+				/* NACK : slave switches to not addressed mode, master sends STOP */
+				twi_sim_host_event(TW_SR_DATA_NACK, 9);
+				sim_advance_ns(twi_sim_bit_ns());
+				return acked;
+			}
+			if(!(cr = twi_sim_host_event(TW_SR_DATA_ACK, 9))) {
+				return -1;
+			}
+			acked++;
+		}
+		/* STOP, or repeated START for the read */
+		if(!twi_sim_host_event(TW_SR_STOP, 1)) {
+			return -1;
+		}
+	}
+	if(rx_count) {
+		if(!twi_sim_host_addressed(addr)) {
+			sim_advance_ns(10 * twi_sim_bit_ns());
+			return -1;
+		}
+		if(!(cr = twi_sim_host_event(TW_ST_SLA_ACK, 10))) {
+			return -1;
+		}
+		for(i = 0; i < rx_count; i++) {
+			rx[i] = TWDR;
+			if(i == rx_count - 1) {
+				cr = twi_sim_host_event(TW_ST_DATA_NACK, 9);
+			}
+			else if(cr & _BV(TWEA)) {
+				cr = twi_sim_host_event(TW_ST_DATA_ACK, 9);
+			}
+			else {
+				/* Last byte sent by the slave, SDA released : the master reads ones */
+				twi_sim_host_event(TW_ST_LAST_DATA, 9);
+				for(i++; i < rx_count; i++) {
+					rx[i] = 0xFF;
+				}
+				break;
+			}
+			if(!cr) {
+				return -1;
+			}
+		}
+		sim_advance_ns(twi_sim_bit_ns());
+	}
+	return acked;
+}
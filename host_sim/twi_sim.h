@@ -0,0 +1,89 @@
+/*
+ *	twi_sim.h
+ *
+ *	Simulated TWI bus for the host build of avr_twi.c
+ *
+ *	Commands written to TWCR (with TWINT) are executed on a bus of device models, taking the
+ *	bus time given by TWBR/TWSR. At the end of each command TWSR gets the real TW_STATUS code, TWINT
+ *	is set and ISR(TWI_vect) is called. The AVR in slave mode is addressed by an external master
+ *	(twi_sim_host_transfer()).
+ */
+
+#ifndef TWI_SIM_H
+#define TWI_SIM_H
+
+#include <stdint.h>
+
+/* CPU cycles for entering and running the TWI interrupt, added before each command issued from it */
+#ifndef TWI_SIM_ISR_CYCLES
+#define TWI_SIM_ISR_CYCLES		60
+#endif
+
+/* SCL periods the external master waits for the AVR to release SCL (TWINT cleared) */
+#ifndef TWI_SIM_HOST_STRETCH_BITS
+#define TWI_SIM_HOST_STRETCH_BITS	1000
+#endif
+
+/* A device on the bus. Device models embed this as their first member */
+typedef struct twi_sim_device {
+	uint8_t		addr;			/* 7-bit slave address */
+	uint8_t		hang;			/* Set to hold SCL low after the next address match (for timeout tests) */
+	uint8_t		(*start)(struct twi_sim_device *dev, uint8_t read);	/* Addressed after (repeated) START. Returns 1 to ACK */
+	uint8_t		(*write)(struct twi_sim_device *dev, uint8_t data);	/* Byte from master. Returns 1 to ACK */
+	uint8_t		(*read)(struct twi_sim_device *dev, uint8_t ack);	/* Byte to master, ack = master will ACK it */
+	void		(*stop)(struct twi_sim_device *dev);				/* STOP, or transaction aborted */
+	struct twi_sim_device *next;
+} twi_sim_device_t;
+
+/* Bus counters since twi_sim_init() or twi_sim_stats_reset() */
+typedef struct {
+	uint32_t	starts;			/* START conditions, including repeated STARTs */
+	uint32_t	rep_starts;		/* Repeated STARTs */
+	uint32_t	stops;
+	uint32_t	addr_nacks;		/* Addresses not acknowledged */
+	uint32_t	data_nacks;		/* Data bytes written and not acknowledged */
+	uint32_t	bytes_tx;		/* Data bytes written by the master (excluding address) */
+	uint32_t	bytes_rx;		/* Data bytes read by the master */
+	uint32_t	arb_lost;		/* Injected arbitration losses */
+	uint32_t	interrupts;		/* TWI interrupts run */
+	uint64_t	busy_ns;		/* Time the bus was busy with master commands */
+} twi_sim_stats_t;
+
+
+/* Resets the bus (no devices) and registers it with the simulator */
+void twi_sim_init(void);
+
+
+/* Connects a device to the bus */
+void twi_sim_attach(twi_sim_device_t *dev);
+
+
+/* Disconnects a device from the bus */
+void twi_sim_detach(twi_sim_device_t *dev);
+
+
+/* Makes the next count address bytes lose arbitration (TW_MT_ARB_LOST) */
+void twi_sim_lose_arbitration(uint8_t count);
+
+
+/* SCL clock frequency (Hz) from TWBR and TWSR prescaler */
+uint32_t twi_sim_scl_hz(void);
+
+
+/* Transaction of the external master with the AVR in slave mode (TWAR), at the SCL rate of TWBR/TWSR:
+ *	writes tx_count bytes, then reads rx_count bytes after a repeated START (only the read if tx_count
+ *	is 0), then sends STOP. The write ends with STOP at the first NACKed byte. The AVR master must be
+ *	idle, and the interrupts enabled.
+ *
+ *		Returns: number of bytes written and ACKed by the AVR
+ *				 -1 - Address not acknowledged, or the AVR did not respond
+ */
+int twi_sim_host_transfer(uint8_t addr, const uint8_t *tx, uint8_t tx_count, uint8_t *rx, uint8_t rx_count);
+
+
+void twi_sim_stats_get(twi_sim_stats_t *stats);
+
+
+void twi_sim_stats_reset(void);
+
+#endif
@@ -0,0 +1,770 @@
+/*
+ *	twi_sim_devices.c
+ *
+ *	Models of DS3231, MPU6050, HMC5883 and SSD1306 for the simulated TWI bus
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "sim.h"
+#include "twi_sim_devices.h"
+
+#define NS_PER_SEC				1000000000ULL
+
+
+/**************************** DS3231 ********************************/
+
+#define DS3231_ADDR				0x68
+#define DS3231_NUM_REGS			0x13
+#define DS3231_STATUS			0x0F
+#define DS3231_TEMP_MSB			0x11
+
+/* Increments BCD value in (*reg & mask) from first to last. Returns 1 on roll over */
+static uint8_t bcd_inc(uint8_t *reg, uint8_t mask, uint8_t first, uint8_t last)
+{
+	uint8_t value = *reg & mask;
+
+	if(value >= last) {
+		value = first;
+	}
+	else if((value & 0xF) == 9) {
+		value = (value & 0xF0) + 0x10;
+	}
+	else {
+		value++;
+	}
+	*reg = (*reg & ~mask) | value;
+	return (value == first);
+}
+
+static uint8_t bcd_to_bin(uint8_t bcd)
+{
+	return (bcd >> 4) * 10 + (bcd & 0xF);
+}
+
+static uint8_t bin_to_bcd(uint8_t bin)
+{
+	return ((bin / 10) << 4) | (bin % 10);
+}
+
+/* Advances the time registers by one second */
+static void ds3231_tick(twi_sim_ds3231_t *rtc)
+{
+	static const uint8_t days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+	uint8_t *r = rtc->regs;
+	uint8_t month, last;
+
+	if(!bcd_inc(&r[0], 0x7F, 0x00, 0x59) || !bcd_inc(&r[1], 0x7F, 0x00, 0x59)) {
+		return;
+	}
+	if(r[2] & 0x40) {
+		/* 12 hour mode : 12, 1, ... 11 with AM/PM bit toggled at 11 -> 12 */
+		if((r[2] & 0x1F) == 0x11) {
+			r[2] = (r[2] & ~0x1F) | 0x12;
+			r[2] ^= 0x20;
+			if(r[2] & 0x20) {
+				return;
+			}
+		}
+		else {
+			bcd_inc(&r[2], 0x1F, 0x01, 0x12);
+			return;
+		}
+	}
+	else if(!bcd_inc(&r[2], 0x3F, 0x00, 0x23)) {
+		return;
+	}
+	bcd_inc(&r[3], 0x07, 0x01, 0x07);
+	month = bcd_to_bin(r[5] & 0x1F);
+	last = days[(month - 1) % 12];
+	if((month == 2) && !(bcd_to_bin(r[6]) & 3)) {
+		last = 29;
+	}
+	if(!bcd_inc(&r[4], 0x3F, 0x01, bin_to_bcd(last))) {
+		return;
+	}
+	if(!bcd_inc(&r[5], 0x1F, 0x01, 0x12)) {
+		return;
+	}
+	if(bcd_inc(&r[6], 0xFF, 0x00, 0x99)) {
+		r[5] ^= 0x80;	/* Century */
+	}
+}
+
+/* Brings the time registers up to the simulated time */
+static void ds3231_update(twi_sim_ds3231_t *rtc)
+{
+	uint64_t now = sim_now_ns();
+
+	while(now >= rtc->next_sec) {
+		ds3231_tick(rtc);
+		rtc->next_sec += NS_PER_SEC;
+	}
+}
+
+static uint8_t ds3231_start(twi_sim_device_t *dev, uint8_t read)
+{
+	twi_sim_ds3231_t *rtc = (twi_sim_ds3231_t *)dev;
+
+	ds3231_update(rtc);
+	rtc->expect_ptr = !read;
+	return 1;
+}
+
+static uint8_t ds3231_write(twi_sim_device_t *dev, uint8_t data)
+{
+	twi_sim_ds3231_t *rtc = (twi_sim_ds3231_t *)dev;
+	uint8_t *reg;
+
+	if(rtc->expect_ptr) {
+		rtc->ptr = (data < DS3231_NUM_REGS) ? data : 0;
+		rtc->expect_ptr = 0;
+		return 1;
+	}
+	reg = &rtc->regs[rtc->ptr];
+	if(rtc->ptr == DS3231_STATUS) {
+		/* OSF, A2F and A1F can only be cleared, BSY is read only */
+		*reg = (*reg & data & 0x83) | (data & 0x08) | (*reg & 0x04);
+	}
+	else if(rtc->ptr < DS3231_TEMP_MSB) {
+		*reg = data;
+		if(rtc->ptr == 0) {
+			rtc->next_sec = sim_now_ns() + NS_PER_SEC;	/* Countdown restarts on write to seconds */
+		}
+	}
+	if(++rtc->ptr >= DS3231_NUM_REGS) {
+		rtc->ptr = 0;
+	}
+	return 1;
+}
+
+static uint8_t ds3231_read(twi_sim_device_t *dev, uint8_t ack)
+{
+	twi_sim_ds3231_t *rtc = (twi_sim_ds3231_t *)dev;
+	uint8_t data = rtc->regs[rtc->ptr];
+
+	if(++rtc->ptr >= DS3231_NUM_REGS) {
+		rtc->ptr = 0;
+	}
+	return data;
+}
+
+void twi_sim_ds3231_init(twi_sim_ds3231_t *rtc)
+{
+	memset(rtc, 0, sizeof(*rtc));
+	rtc->regs[3] = 0x01;	/* Day */
+	rtc->regs[4] = 0x01;	/* Date */
+	rtc->regs[5] = 0x01;	/* Month */
+	rtc->regs[0x0E] = 0x1C;	/* Control: INTCN, RS2, RS1 */
+	rtc->regs[DS3231_STATUS] = 0x88;	/* OSF, EN32kHz */
+	rtc->regs[DS3231_TEMP_MSB] = 25;
+	rtc->next_sec = sim_now_ns() + NS_PER_SEC;
+	rtc->dev.addr = DS3231_ADDR;
+	rtc->dev.start = ds3231_start;
+	rtc->dev.write = ds3231_write;
+	rtc->dev.read = ds3231_read;
+	twi_sim_attach(&rtc->dev);
+}
+
+
+/**************************** MPU6050 ********************************/
+
+#define MPU6050_INT_STATUS		0x3A
+#define MPU6050_ACCEL_XOUT_H	0x3B
+#define MPU6050_TEMP_OUT_H		0x41
+#define MPU6050_GYRO_XOUT_H		0x43
+#define MPU6050_EXT_SENS_END	0x60
+#define MPU6050_PWR_MGMT_1		0x6B
+#define MPU6050_WHO_AM_I		0x75
+
+static uint8_t mpu6050_start(twi_sim_device_t *dev, uint8_t read)
+{
+	((twi_sim_mpu6050_t *)dev)->expect_ptr = !read;
+	return 1;
+}
+
+static uint8_t mpu6050_write(twi_sim_device_t *dev, uint8_t data)
+{
+	twi_sim_mpu6050_t *mpu = (twi_sim_mpu6050_t *)dev;
+
+	if(mpu->expect_ptr) {
+		mpu->ptr = data & 0x7F;
+		mpu->expect_ptr = 0;
+		return 1;
+	}
+	/* Sample, status and WHO_AM_I registers are read only */
+	if(((mpu->ptr < MPU6050_INT_STATUS) || (mpu->ptr > MPU6050_EXT_SENS_END)) && (mpu->ptr != MPU6050_WHO_AM_I)) {
+		mpu->regs[mpu->ptr] = data;
+	}
+	mpu->ptr = (mpu->ptr + 1) & 0x7F;
+	return 1;
+}
+
+static uint8_t mpu6050_read(twi_sim_device_t *dev, uint8_t ack)
+{
+	twi_sim_mpu6050_t *mpu = (twi_sim_mpu6050_t *)dev;
+	uint8_t data = mpu->regs[mpu->ptr];
+
+	if(mpu->ptr == MPU6050_INT_STATUS) {
+		mpu->regs[MPU6050_INT_STATUS] = 0;	/* Cleared on read */
+	}
+	mpu->ptr = (mpu->ptr + 1) & 0x7F;
+	return data;
+}
+
+static void put_be16(uint8_t *buf, int16_t value)
+{
+	buf[0] = (uint16_t)value >> 8;
+	buf[1] = value & 0xFF;
+}
+
+void twi_sim_mpu6050_set_sample(twi_sim_mpu6050_t *mpu, const int16_t accel[3], int16_t temp, const int16_t gyro[3])
+{
+	uint8_t i;
+
+	for(i = 0; i < 3; i++) {
+		put_be16(&mpu->regs[MPU6050_ACCEL_XOUT_H + 2 * i], accel[i]);
+		put_be16(&mpu->regs[MPU6050_GYRO_XOUT_H + 2 * i], gyro[i]);
+	}
+	put_be16(&mpu->regs[MPU6050_TEMP_OUT_H], temp);
+	mpu->regs[MPU6050_INT_STATUS] |= 0x01;	/* DATA_RDY_INT */
+}
+
+void twi_sim_mpu6050_init(twi_sim_mpu6050_t *mpu, uint8_t addr)
+{
+	memset(mpu, 0, sizeof(*mpu));
+	mpu->regs[MPU6050_PWR_MGMT_1] = 0x40;	/* Sleep */
+	mpu->regs[MPU6050_WHO_AM_I] = 0x68;
+	mpu->dev.addr = addr;
+	mpu->dev.start = mpu6050_start;
+	mpu->dev.write = mpu6050_write;
+	mpu->dev.read = mpu6050_read;
+	twi_sim_attach(&mpu->dev);
+}
+
+
+/**************************** HMC5883 ********************************/
+
+#define HMC5883_ADDR			0x1E
+#define HMC5883_NUM_REGS		13
+#define HMC5883_MODE			0x02
+#define HMC5883_DATA_X_MSB		0x03
+#define HMC5883_DATA_Y_LSB		0x08
+#define HMC5883_STATUS			0x09
+
+static uint8_t hmc5883_start(twi_sim_device_t *dev, uint8_t read)
+{
+	((twi_sim_hmc5883_t *)dev)->expect_ptr = !read;
+	return 1;
+}
+
+static uint8_t hmc5883_write(twi_sim_device_t *dev, uint8_t data)
+{
+	twi_sim_hmc5883_t *mag = (twi_sim_hmc5883_t *)dev;
+
+	if(mag->expect_ptr) {
+		mag->ptr = (data < HMC5883_NUM_REGS) ? data : 0;
+		mag->expect_ptr = 0;
+		return 1;
+	}
+	if(mag->ptr <= HMC5883_MODE) {
+		mag->regs[mag->ptr] = data;
+	}
+	if(++mag->ptr >= HMC5883_NUM_REGS) {
+		mag->ptr = 0;
+	}
+	return 1;
+}
+
+static uint8_t hmc5883_read(twi_sim_device_t *dev, uint8_t ack)
+{
+	twi_sim_hmc5883_t *mag = (twi_sim_hmc5883_t *)dev;
+	uint8_t data = mag->regs[mag->ptr];
+
+	if(mag->ptr == HMC5883_DATA_Y_LSB) {
+		/* Pointer returns to the first data register after all 6 are read */
+		mag->ptr = HMC5883_DATA_X_MSB;
+		mag->regs[HMC5883_STATUS] &= ~0x01;		/* RDY */
+	}
+	else if(++mag->ptr >= HMC5883_NUM_REGS) {
+		mag->ptr = 0;
+	}
+	return data;
+}
+
+void twi_sim_hmc5883_set_sample(twi_sim_hmc5883_t *mag, int16_t x, int16_t y, int16_t z)
+{
+	/* Output order is X, Z, Y */
+	put_be16(&mag->regs[HMC5883_DATA_X_MSB], x);
+	put_be16(&mag->regs[HMC5883_DATA_X_MSB + 2], z);
+	put_be16(&mag->regs[HMC5883_DATA_X_MSB + 4], y);
+	mag->regs[HMC5883_STATUS] |= 0x01;
+}
+
+void twi_sim_hmc5883_init(twi_sim_hmc5883_t *mag)
+{
+	memset(mag, 0, sizeof(*mag));
+	mag->regs[0] = 0x10;	/* Config A */
+	mag->regs[1] = 0x20;	/* Config B */
+	mag->regs[HMC5883_MODE] = 0x01;		/* Single measurement */
+	mag->regs[10] = 'H';	/* Identification */
+	mag->regs[11] = '4';
+	mag->regs[12] = '3';
+	mag->dev.addr = HMC5883_ADDR;
+	mag->dev.start = hmc5883_start;
+	mag->dev.write = hmc5883_write;
+	mag->dev.read = hmc5883_read;
+	twi_sim_attach(&mag->dev);
+}
+
+
+/**************************** SSD1306 ********************************/
+
+/* Number of argument bytes of a command */
+static uint8_t ssd1306_cmd_args(uint8_t cmd)
+{
+	switch(cmd) {
+		case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+			return 1;
+		case 0x21: case 0x22: case 0xA3:
+			return 2;
+		case 0x29: case 0x2A:
+			return 5;
+		case 0x26: case 0x27:
+			return 6;
+		default:
+			return 0;
+	}
+}
+
+static void ssd1306_execute(twi_sim_ssd1306_t *oled)
+{
+	uint8_t *cmd = oled->cmd;
+
+	oled->cmds++;
+	if(cmd[0] <= 0x0F) {			/* Lower column start (page addressing) */
+		oled->col = (oled->col & 0xF0) | (cmd[0] & 0x0F);
+	}
+	else if(cmd[0] <= 0x1F) {		/* Higher column start (page addressing) */
+		oled->col = (oled->col & 0x0F) | ((cmd[0] & 0x07) << 4);
+	}
+	else if((cmd[0] >= 0xB0) && (cmd[0] <= 0xB7)) {	/* Page start (page addressing) */
+		oled->page = cmd[0] & 0x7;
+	}
+	else {
+		switch(cmd[0]) {
+			case 0x20:
+				if((cmd[1] & 0x3) != 0x3) {
+					oled->addr_mode = cmd[1] & 0x3;
+				}
+				break;
+			case 0x21:
+				oled->col_start = oled->col = cmd[1] & 0x7F;
+				oled->col_end = cmd[2] & 0x7F;
+				break;
+			case 0x22:
+				oled->page_start = oled->page = cmd[1] & 0x7;
+				oled->page_end = cmd[2] & 0x7;
+				break;
+			case 0x81:
+				oled->contrast = cmd[1];
+				break;
+			case 0x8D:
+				oled->charge_pump = (cmd[1] & 0x04) != 0;
+				break;
+			case 0xA6:
+			case 0xA7:
+				oled->inverse = cmd[0] & 1;
+				break;
+			case 0xAE:
+			case 0xAF:
+				oled->display_on = cmd[0] & 1;
+				break;
+		}
+	}
+}
+
+/* Writes GDDRAM at the RAM pointer and advances it as per addressing mode */
+static void ssd1306_ram_write(twi_sim_ssd1306_t *oled, uint8_t data)
+{
+	oled->gddram[oled->page][oled->col & 0x7F] = data;
+	oled->data_bytes++;
+	switch(oled->addr_mode) {
+		case 0:	/* Horizontal */
+			if(oled->col >= oled->col_end) {
+				oled->col = oled->col_start;
+				oled->page = (oled->page >= oled->page_end) ? oled->page_start : oled->page + 1;
+			}
+			else {
+				oled->col++;
+			}
+			break;
+		case 1:	/* Vertical */
+			if(oled->page >= oled->page_end) {
+				oled->page = oled->page_start;
+				oled->col = (oled->col >= oled->col_end) ? oled->col_start : oled->col + 1;
+			}
+			else {
+				oled->page++;
+			}
+			break;
+		default: /* Page */
+			oled->col = (oled->col >= oled->col_end) ? oled->col_start : oled->col + 1;
+			break;
+	}
+}
+
+static uint8_t ssd1306_start(twi_sim_device_t *dev, uint8_t read)
+{
+	twi_sim_ssd1306_t *oled = (twi_sim_ssd1306_t *)dev;
+
+	if(read) {
+		return 0;	/* No read in I2C mode */
+	}
+	oled->control = 1;
+	oled->cmd_len = 0;
+	return 1;
+}
+
+static uint8_t ssd1306_write(twi_sim_device_t *dev, uint8_t data)
+{
+	twi_sim_ssd1306_t *oled = (twi_sim_ssd1306_t *)dev;
+
+	if(oled->control) {
+		oled->cont = data >> 7;
+		oled->data = (data >> 6) & 1;
+		oled->control = 0;
+		return 1;
+	}
+	if(oled->data) {
+		ssd1306_ram_write(oled, data);
+	}
+	else {
+		oled->cmd[oled->cmd_len++] = data;
+		if(oled->cmd_len > ssd1306_cmd_args(oled->cmd[0])) {
+			ssd1306_execute(oled);
+			oled->cmd_len = 0;
+		}
+	}
+	/* Co = 1 : a control byte follows each byte */
+	oled->control = oled->cont;
+	return 1;
+}
+
+static uint8_t ssd1306_read(twi_sim_device_t *dev, uint8_t ack)
+{
+	return 0xFF;
+}
+
+uint8_t twi_sim_ssd1306_pixel(twi_sim_ssd1306_t *oled, uint8_t x, uint8_t y)
+{
+	return (oled->gddram[(y >> 3) & 0x7][x & 0x7F] >> (y & 0x7)) & 1;
+}
+
+void twi_sim_ssd1306_init(twi_sim_ssd1306_t *oled, uint8_t addr)
+{
+	memset(oled, 0, sizeof(*oled));
+	oled->addr_mode = 2;	/* Page addressing */
+	oled->col_end = 127;
+	oled->page_end = 7;
+	oled->contrast = 0x7F;
+	oled->dev.addr = addr;
+	oled->dev.start = ssd1306_start;
+	oled->dev.write = ssd1306_write;
+	oled->dev.read = ssd1306_read;
+	twi_sim_attach(&oled->dev);
+}
+
+
+/**************************** Pin-level bus ********************************/
+
+/* Time the rival master keeps the bus after winning arbitration, before its STOP */
+#define PINS_RIVAL_NS			20000
+
+enum {
+	PINS_IDLE = 0,
+	PINS_ADDR,				/* SLA+R/W from master */
+	PINS_WRITE,				/* Data from master */
+	PINS_READ,				/* Data to master */
+	PINS_IGNORE				/* Not addressed, NACK or arbitration lost: wait for START/STOP */
+};
+
+static twi_sim_pins_t	*_pins_list;
+
+static void pins_poll(void);
+static uint64_t pins_next_event(void);
+static void pins_event(void);
+
+static sim_peripheral_t	_pins_periph = { pins_poll, pins_next_event, pins_event, 0 };
+
+
+static uint8_t pins_scl(twi_sim_pins_t *s)
+{
+	return !(*s->ddr & s->scl_mask) && !s->scl_hold;
+}
+
+
+static uint8_t pins_sda(twi_sim_pins_t *s)
+{
+	return !(*s->ddr & s->sda_mask) && !s->sda_low && !s->rival_low;
+}
+
+
+/* Rival master drives SDA LOW for a 0 in the current bit of its address */
+static void pins_rival_bit(twi_sim_pins_t *s)
+{
+	s->rival_low = s->rival_on && (s->bit < 8) && !((s->rival << s->bit) & 0x80);
+}
+
+
+/* SDA edge while SCL is HIGH */
+static void pins_start_stop(twi_sim_pins_t *s, uint8_t sda)
+{
+	if(!sda) {
+		/* START, or repeated START */
+		s->starts++;
+		s->dev = 0;
+		s->state = PINS_ADDR;
+		s->bit = 0;
+		s->data = 0;
+		s->sda_low = 0;
+		if(s->rival && !s->rival_low) {
+			s->rival_on = 1;
+			pins_rival_bit(s);
+		}
+		return;
+	}
+	/* STOP */
+	s->stops++;
+	if(s->dev && s->dev->stop) {
+		s->dev->stop(s->dev);
+	}
+	s->dev = 0;
+	s->state = PINS_IDLE;
+	s->sda_low = 0;
+}
+
+
+/* Next byte from the device, first bit driven on SDA */
+static void pins_load(twi_sim_pins_t *s)
+{
+	s->data = s->dev->read(s->dev, 1);
+	s->bytes++;
+	s->bit = 0;
+	s->sda_low = !(s->data & 0x80);
+}
+
+
+/* SCL rising : master and devices sample SDA. 'bit' counts the bits sampled, 9 after the ACK bit */
+static void pins_scl_rise(twi_sim_pins_t *s)
+{
+	uint8_t master = !(*s->ddr & s->sda_mask);
+
+	if((s->state == PINS_ADDR) || (s->state == PINS_WRITE)) {
+		if(s->bit < 8) {
+			s->data = (s->data << 1) | s->sda;
+			s->bit++;
+			if(s->rival_on && master && s->rival_low) {
+				/* Master sends 1, rival 0 : the rival wins and keeps the bus until its STOP */
+				s->rival_on = 0;
+				s->rival = 0;
+				s->rival_stop = sim_now_ns() + PINS_RIVAL_NS;
+				s->state = PINS_IGNORE;
+			}
+			else if(s->rival_on && !master && !s->rival_low) {
+				/* Rival loses and stops driving */
+				s->rival_on = 0;
+				s->rival = 0;
+			}
+		}
+		else {
+			s->bit = 9;
+		}
+	}
+	else if(s->state == PINS_READ) {
+		if(s->bit == 8) {
+			s->ack = !s->sda;
+		}
+		s->bit++;
+	}
+}
+
+
+/* SCL falling : devices change SDA */
+static void pins_scl_fall(twi_sim_pins_t *s)
+{
+	twi_sim_device_t *dev;
+
+	if((s->state == PINS_ADDR) || (s->state == PINS_WRITE)) {
+		if(s->bit < 8) {
+			pins_rival_bit(s);
+		}
+		else if(s->bit == 8) {
+			/* Byte received : device drives the ACK bit, and may stretch the clock before it */
+			if(s->state == PINS_ADDR) {
+				s->rival_on = 0;
+				s->rival_low = 0;
+				s->rival = 0;
+				for(dev = s->devices; dev && (dev->addr != (s->data >> 1)); dev = dev->next)
+					;
+				s->ack = dev && dev->start(dev, s->data & 1);
+				s->dev = s->ack ? dev : 0;
+			}
+			else {
+				s->ack = s->dev->write(s->dev, s->data);
+				s->bytes++;
+			}
+			s->sda_low = s->ack;
+			if(s->ack && s->stretch_ns) {
+				s->scl_hold = 1;
+				s->stretched = 1;
+				s->scl_release = sim_now_ns() + s->stretch_ns;
+			}
+		}
+		else {
+			/* End of ACK bit */
+			s->sda_low = 0;
+			if(!s->ack) {
+				s->state = PINS_IGNORE;
+			}
+			else if((s->state == PINS_ADDR) && (s->data & 1)) {
+				s->state = PINS_READ;
+				pins_load(s);
+			}
+			else {
+				s->state = PINS_WRITE;
+				s->bit = 0;
+				s->data = 0;
+			}
+		}
+	}
+	else if(s->state == PINS_READ) {
+		if(s->bit < 8) {
+			s->sda_low = !((s->data << s->bit) & 0x80);
+		}
+		else if(s->bit == 8) {
+			s->sda_low = 0;		/* Released for the ACK of the master */
+		}
+		else if(s->ack) {
+			pins_load(s);
+		}
+		else {
+			s->sda_low = 0;
+			s->state = PINS_IGNORE;
+		}
+	}
+}
+
+
+/* Handles the line edges since the last update. Both lines may have changed: SDA only changes while SCL
+ * is LOW, so an SCL fall is handled before the SDA edge and an SCL rise after it
+ */
+static void pins_update(twi_sim_pins_t *s)
+{
+	uint64_t now = sim_now_ns();
+	uint8_t level;
+
+	if(s->scl && !pins_scl(s)) {
+		s->scl = 0;
+		if(now - s->scl_edge < s->scl_high_min_ns) {
+			s->scl_high_min_ns = now - s->scl_edge;
+		}
+		s->scl_edge = now;
+		pins_scl_fall(s);
+	}
+	level = pins_sda(s);
+	if(level != s->sda) {
+		s->sda = level;
+		if(s->scl) {
+			pins_start_stop(s, level);
+		}
+	}
+	if(!s->scl && pins_scl(s)) {
+		s->scl = 1;
+		if(!s->stretched && (now - s->scl_edge < s->scl_low_min_ns)) {
+			s->scl_low_min_ns = now - s->scl_edge;
+		}
+		s->stretched = 0;
+		s->scl_edge = now;
+		pins_scl_rise(s);
+	}
+	level = (s->scl ? s->scl_mask : 0) | (pins_sda(s) ? s->sda_mask : 0);
+	*s->pin = (*s->pin & ~(s->scl_mask | s->sda_mask)) | level;
+}
+
+
+static void pins_poll(void)
+{
+	twi_sim_pins_t *s;
+
+	for(s = _pins_list; s; s = s->next) {
+		pins_update(s);
+	}
+}
+
+
+static uint64_t pins_next_event(void)
+{
+	twi_sim_pins_t *s;
+	uint64_t t = UINT64_MAX;
+
+	for(s = _pins_list; s; s = s->next) {
+		if(s->scl_hold && (s->scl_release < t)) {
+			t = s->scl_release;
+		}
+		if(s->rival_low && !s->rival_on && (s->rival_stop < t)) {
+			t = s->rival_stop;
+		}
+	}
+	return t;
+}
+
+
+/* End of stretching, or STOP of the rival master */
+static void pins_event(void)
+{
+	twi_sim_pins_t *s;
+	uint64_t now = sim_now_ns();
+
+	for(s = _pins_list; s; s = s->next) {
+		if(s->scl_hold && (s->scl_release <= now)) {
+			s->scl_hold = 0;
+		}
+		if(s->rival_low && !s->rival_on && (s->rival_stop <= now)) {
+			s->rival_low = 0;
+		}
+		pins_update(s);
+	}
+}
+
+
+void twi_sim_pins_init(twi_sim_pins_t *bus, volatile uint8_t *ddr, volatile uint8_t *pin, uint8_t scl_bit, uint8_t sda_bit)
+{
+	twi_sim_pins_t **p;
+
+	for(p = &_pins_list; *p; p = &(*p)->next) {
+		if(*p == bus) {
+			*p = bus->next;
+			break;
+		}
+	}
+	memset(bus, 0, sizeof(*bus));
+	bus->ddr = ddr;
+	bus->pin = pin;
+	bus->scl_mask = (1 << scl_bit);
+	bus->sda_mask = (1 << sda_bit);
+	bus->scl = bus->sda = 1;
+	bus->scl_edge = sim_now_ns();
+	bus->scl_low_min_ns = bus->scl_high_min_ns = UINT32_MAX;
+	*pin |= bus->scl_mask | bus->sda_mask;
+	bus->next = _pins_list;
+	_pins_list = bus;
+	sim_add_peripheral(&_pins_periph);
+}
+
+
+void twi_sim_pins_attach(twi_sim_pins_t *bus, twi_sim_device_t *dev)
+{
+	dev->next = bus->devices;
+	bus->devices = dev;
+}
@@ -0,0 +1,130 @@
+/*
+ *	twi_sim_devices.h
+ *
+ *	Models of the I2C devices used by the drivers in this repository, for the simulated TWI bus (twi_sim.h),
+ *	and a pin-level bus to connect them to the bit-banged master (soft_twi.c)
+ *
+ *	All models have an auto-incrementing register pointer set by the first byte written after SLA+W,
+ *	as the real devices. Register contents are public, to be preset and checked by the test program.
+ */
+
+#ifndef TWI_SIM_DEVICES_H
+#define TWI_SIM_DEVICES_H
+
+#include <stdint.h>
+#include "twi_sim.h"
+
+/* DS3231 RTC : time registers in BCD, counting with the simulated time */
+typedef struct {
+	twi_sim_device_t	dev;
+	uint8_t				regs[0x13];
+	uint8_t				ptr;
+	uint8_t				expect_ptr;
+	uint64_t			next_sec;	/* Simulated time (ns) of the next seconds increment */
+} twi_sim_ds3231_t;
+
+/* MPU6050 accelerometer/gyro : 128 registers, samples at 0x3B - 0x48 */
+typedef struct {
+	twi_sim_device_t	dev;
+	uint8_t				regs[128];
+	uint8_t				ptr;
+	uint8_t				expect_ptr;
+} twi_sim_mpu6050_t;
+
+/* HMC5883 magnetometer : 13 registers, data output at 0x3 - 0x8 */
+typedef struct {
+	twi_sim_device_t	dev;
+	uint8_t				regs[13];
+	uint8_t				ptr;
+	uint8_t				expect_ptr;
+} twi_sim_hmc5883_t;
+
+/* SSD1306 OLED controller : command decoder and 128x64 GDDRAM */
+typedef struct {
+	twi_sim_device_t	dev;
+	uint8_t				gddram[8][128];	/* [page][column], bit 0 is the top row of the page */
+	uint8_t				addr_mode;		/* 0: horizontal, 1: vertical, 2: page */
+	uint8_t				col, page;		/* RAM pointer */
+	uint8_t				col_start, col_end;
+	uint8_t				page_start, page_end;
+	uint8_t				display_on;
+	uint8_t				inverse;
+	uint8_t				contrast;
+	uint8_t				charge_pump;
+	/* Used by the decoder */
+	uint8_t				control;		/* Control byte expected */
+	uint8_t				cont;			/* Co bit of last control byte: one byte follows */
+	uint8_t				data;			/* D/C# bit of last control byte */
+	uint8_t				cmd[7];			/* Command being received (opcode and arguments) */
+	uint8_t				cmd_len;
+	/* Counters */
+	uint32_t			cmds;			/* Commands executed */
+	uint32_t			data_bytes;		/* Bytes written to GDDRAM */
+} twi_sim_ssd1306_t;
+
+
+/* Initializes the model to device reset state, with the default address, and attaches it to the bus */
+void twi_sim_ds3231_init(twi_sim_ds3231_t *rtc);
+void twi_sim_mpu6050_init(twi_sim_mpu6050_t *mpu, uint8_t addr);	/* addr: 0x68 or 0x69 (AD0 pin) */
+void twi_sim_hmc5883_init(twi_sim_hmc5883_t *mag);
+void twi_sim_ssd1306_init(twi_sim_ssd1306_t *oled, uint8_t addr);	/* addr: 0x3C or 0x3D */
+
+
+/* Sets the next MPU6050 sample (raw register values) */
+void twi_sim_mpu6050_set_sample(twi_sim_mpu6050_t *mpu, const int16_t accel[3], int16_t temp, const int16_t gyro[3]);
+
+
+/* Sets the next HMC5883 sample and the data ready bit */
+void twi_sim_hmc5883_set_sample(twi_sim_hmc5883_t *mag, int16_t x, int16_t y, int16_t z);
+
+
+/* Returns pixel at x (0 - 127), y (0 - 63) of the OLED RAM */
+uint8_t twi_sim_ssd1306_pixel(twi_sim_ssd1306_t *oled, uint8_t x, uint8_t y);
+
+
+/* Pin-level I2C bus for a bit-banged master (soft_twi.c). SCL and SDA are open-drain: a line is LOW when the
+ * master sets its DDR bit (PORT bit 0) or a device drives it, and the model writes the levels to the PIN
+ * register. START, STOP and the bits are decoded from the line edges, and the bytes are exchanged with
+ * the device models attached to this bus (twi_sim_pins_attach()) instead of the TWI module bus.
+ */
+typedef struct twi_sim_pins {
+	volatile uint8_t		*ddr;				/* DDR register of SCL and SDA */
+	volatile uint8_t		*pin;				/* PIN register of SCL and SDA */
+	uint8_t					scl_mask;
+	uint8_t					sda_mask;
+	twi_sim_device_t		*devices;
+	uint64_t				stretch_ns;			/* Time the addressed device holds SCL low before the ACK of each byte it receives */
+	uint8_t					rival;				/* SLA+R/W sent by another master from the next START, 0 for none */
+	/* Used by the model */
+	uint8_t					scl, sda;			/* Line levels last seen */
+	uint8_t					state;
+	uint8_t					bit;				/* Bits of the current byte clocked, 9 after the ACK bit */
+	uint8_t					data;
+	uint8_t					ack;
+	uint8_t					sda_low;			/* Device drives SDA LOW */
+	uint8_t					scl_hold;			/* Device holds SCL LOW (stretching) */
+	uint8_t					rival_on;			/* Rival master is sending its address */
+	uint8_t					rival_low;			/* Rival master drives SDA LOW */
+	uint8_t					stretched;			/* SCL was held during the current LOW time */
+	uint64_t				scl_release;		/* End of stretching */
+	uint64_t				rival_stop;			/* STOP of the rival master after it won the bus */
+	uint64_t				scl_edge;			/* Time of the last SCL edge */
+	twi_sim_device_t		*dev;				/* Addressed device */
+	struct twi_sim_pins		*next;
+	/* Counters */
+	uint32_t				starts;				/* START conditions, including repeated STARTs */
+	uint32_t				stops;
+	uint32_t				bytes;				/* Data bytes written and read, excluding address */
+	uint32_t				scl_low_min_ns;		/* Shortest SCL LOW time driven by the master (not stretched) */
+	uint32_t				scl_high_min_ns;	/* Shortest SCL HIGH time */
+} twi_sim_pins_t;
+
+
+/* Releases both lines and connects the bus model to the pins (no devices attached) */
+void twi_sim_pins_init(twi_sim_pins_t *bus, volatile uint8_t *ddr, volatile uint8_t *pin, uint8_t scl_bit, uint8_t sda_bit);
+
+
+/* Connects a device model to the pin-level bus. Detach it from the TWI module bus first (twi_sim_detach()) */
+void twi_sim_pins_attach(twi_sim_pins_t *bus, twi_sim_device_t *dev);
+
+#endif
@@ -0,0 +1,461 @@
+/*
+ *	twi_test.c
+ *
+ *	Tests of avr_twi.c, twi_sampler.c and the I2C device drivers on the simulated bus (make test)
+ *
+ *	Each test starts with an empty bus and attaches the device models it uses (DS3231 and MPU6050 share
+ *	address 0x68, as the real devices). Failed checks are printed, and the
+ *	program exits with 1 if any check failed.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "sim.h"
+#include "twi_sim.h"
+#include "twi_sim_devices.h"
+#include "avr_twi.h"
+#include "twi_sampler.h"
+#include "soft_twi.h"
+#include "ds3231.h"
+#include "mpu6050.h"
+#include "hmc5883.h"
+#include "ssd1306.h"
+
+#define CHECK(cond)		do { \
+							if(!(cond)) { \
+								printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+								_failures++; \
+							} \
+						} while(0)
+
+static unsigned				_failures;
+
+static twi_sim_ds3231_t		_rtc;
+static twi_sim_mpu6050_t	_mpu;
+static twi_sim_hmc5883_t	_mag;
+static twi_sim_ssd1306_t	_oled;
+static twi_sim_pins_t		_soft_bus;
+
+
+/* Empty bus, simulated time 0 */
+static void test_setup(void)
+{
+	sim_reset();
+	twi_sim_init();
+	TWI_Init();
+	sei();
+}
+
+
+static void test_ds3231(void)
+{
+	ds3231_time_t time = { .sec = 0x58, .min = 0x59, .hour = 0x23, .day = 7, .date = 0x31, .month = 0x12, .year = 0x24 };
+	ds3231_alarm_t alarm = { .min = 0x30, .hour = 0x06 };
+	bool on;
+	uint8_t status;
+
+	twi_sim_ds3231_init(&_rtc);
+	CHECK(ds3231_init() == 0);
+	CHECK(_rtc.regs[0x07] == 0x80 && _rtc.regs[0x0A] == 0x81);	/* Alarm 1 masked */
+
+	CHECK(ds3231_set_time(&time) == 0);
+	CHECK(memcmp(_rtc.regs, &time, sizeof(time)) == 0);
+	_delay_ms(2500);
+	memset(&time, 0, sizeof(time));
+	CHECK(ds3231_read_time(&time) == 0);
+	CHECK(time.sec == 0x00 && time.min == 0x00 && time.hour == 0x00);	/* Rolled over to new year */
+	CHECK(time.date == 0x01 && time.month == 0x01 && time.year == 0x25 && time.day == 1);
+
+	CHECK(ds3231_set_alarm2(&alarm, ALARM_DAILY) == 0);
+	CHECK(ds3231_alarm2_onoff(true) == 0);
+	memset(&alarm, 0, sizeof(alarm));
+	CHECK(ds3231_read_alarm2(&alarm, &on) == 0);
+	CHECK(alarm.min == 0x30 && alarm.hour == 0x06 && on);
+
+	_rtc.regs[0x0F] |= 0x02;	/* A2F */
+	CHECK(ds3231_read_status(&status) == 0);
+	CHECK(status & 0x02);
+	CHECK(!(_rtc.regs[0x0F] & 0x02));	/* Cleared by the driver */
+}
+
+
+static void test_mpu6050(void)
+{
+	static const int16_t accel[3] = { 1000, -2000, 16384 };
+	static const int16_t gyro[3] = { -1, 300, -32768 };
+	twi_sim_stats_t stats;
+	uint8_t buf[14];
+
+	twi_sim_mpu6050_init(&_mpu, 0x68);
+	CHECK(mpu6050_init(MPU6050_NORMAL_MODE) == 0);
+	CHECK(_mpu.regs[0x6B] == 0x08);		/* Awake, temperature sensor off */
+	CHECK(_mpu.regs[0x1A] == 0x06);		/* 5Hz low-pass filter */
+	CHECK(_mpu.regs[0x1C] == 0x18);		/* +/-16g */
+
+	twi_sim_mpu6050_set_sample(&_mpu, accel, 0x1234, gyro);
+	memset(buf, 0xAA, sizeof(buf));
+	twi_sim_stats_reset();
+	CHECK(mpu6050_get_data(buf, sizeof(buf)) == 0);
+	twi_sim_stats_get(&stats);
+	CHECK(stats.bytes_rx == sizeof(buf));	/* Last byte NACKed, no extra byte read */
+	CHECK((int16_t)((buf[0] << 8) | buf[1]) == 1000);
+	CHECK((int16_t)((buf[2] << 8) | buf[3]) == -2000);
+	CHECK((int16_t)((buf[6] << 8) | buf[7]) == 0x1234);
+	CHECK((int16_t)((buf[12] << 8) | buf[13]) == -32768);
+
+	/* Single byte read: the only byte is the last one, received with NACK */
+	memset(buf, 0xAA, sizeof(buf));
+	CHECK(mpu6050_get_data(buf, 1) == 0);
+	CHECK(buf[0] == 0x03 && buf[1] == 0xAA);
+}
+
+
+static void test_hmc5883(void)
+{
+	uint8_t buf[6];
+
+	twi_sim_hmc5883_init(&_mag);
+	CHECK(hmc5883_init(HMC5883_DEFAULT_CONFIG, HMC5883_MODE_CONTINUOUS, HMC5883_GAIN_4_0) == 0);
+	CHECK(_mag.regs[0] == HMC5883_DEFAULT_CONFIG);
+	CHECK(_mag.regs[1] == HMC5883_GAIN_4_0);
+	CHECK(_mag.regs[2] == HMC5883_MODE_CONTINUOUS);
+
+	twi_sim_hmc5883_set_sample(&_mag, 100, -200, 300);
+	memset(buf, 0xAA, sizeof(buf));
+	CHECK(hmc5883_get_data(buf) == 0);
+	CHECK((int16_t)((buf[0] << 8) | buf[1]) == 100);	/* X */
+	CHECK((int16_t)((buf[2] << 8) | buf[3]) == 300);	/* Z */
+	CHECK((int16_t)((buf[4] << 8) | buf[5]) == -200);	/* Y */
+}
+
+
+static void test_ssd1306(void)
+{
+	uint8_t x;
+
+	twi_sim_ssd1306_init(&_oled, OLED_I2C_SLA_ADDR);
+	CHECK(oled_init() == 0);
+	CHECK(_oled.display_on);
+	CHECK(_oled.charge_pump);
+
+	oled_horizontal_line(10, 20, 13);
+	for(x = 0; x < 128; x++) {
+		CHECK(twi_sim_ssd1306_pixel(&_oled, x, 13) == ((x >= 10) && (x <= 20)));
+	}
+	CHECK(!twi_sim_ssd1306_pixel(&_oled, 15, 12));
+
+	oled_clear_display();
+	CHECK(!twi_sim_ssd1306_pixel(&_oled, 15, 13));
+}
+
+
+static void test_missing_device(void)
+{
+	twi_sim_hmc5883_init(&_mag);
+	CHECK(!TWI_Device_Present(0x68));
+	CHECK(mpu6050_init(MPU6050_NORMAL_MODE) == TWI_STATUS_NOACK);
+	CHECK(ds3231_init() == TWI_STATUS_NOACK);
+	CHECK(oled_init() == TWI_STATUS_NOACK);
+	CHECK(TWI_Device_Present(0x1E));
+}
+
+
+static void test_timeout(void)
+{
+	uint8_t buf[6];
+	twi_params_t params = { .slave_addr = 0x1E, .tx_prefix = {0x03}, .tx_prefix_count = 1, .rx_buf = buf, .rx_count = 6 };
+
+#if TWI_SLEEP_WAIT && !TWI_SLEEP_TIMEOUT_TICKS
+	return;		/* Built to wait forever */
+#endif
+	twi_sim_hmc5883_init(&_mag);
+	_mag.dev.hang = 1;
+	CHECK(TWI_Master_Transfer(&params) == TWI_STATUS_TIMEOUT);
+	CHECK(TWI_Master_Status() == TWI_STATUS_TIMEOUT);
+	/* Bus is usable after recovery */
+	CHECK(TWI_Master_Transfer(&params) == TWI_STATUS_DONE);
+}
+
+
+static void test_arbitration(void)
+{
+	uint8_t buf[6];
+	twi_params_t params = { .slave_addr = 0x1E, .tx_prefix = {0x03}, .tx_prefix_count = 1, .rx_buf = buf, .rx_count = 6 };
+
+	twi_sim_hmc5883_init(&_mag);
+	twi_sim_hmc5883_set_sample(&_mag, 1, 2, 3);
+	twi_sim_lose_arbitration(TWI_ARB_RETRIES);
+	CHECK(TWI_Master_Transfer(&params) == TWI_STATUS_DONE);
+	CHECK(buf[1] == 1 && buf[3] == 3 && buf[5] == 2);
+
+	twi_sim_lose_arbitration(TWI_ARB_RETRIES + 1);
+	CHECK(TWI_Master_Transfer(&params) == TWI_STATUS_ARBLOST);
+	CHECK(TWI_Master_Transfer(&params) == TWI_STATUS_DONE);
+}
+
+
+/* Samples chained from the completion callback: STOP between transfers, and the chain survives failures */
+static void test_sampler(void)
+{
+	static uint8_t mpu_slots[2 * 14];
+	static uint8_t mag_slots[2 * 6];
+	static twi_sample_t mpu_sample = { .params = { .slave_addr = 0x68, .tx_prefix = {0x3B}, .tx_prefix_count = 1, .rx_count = 14 },
+									   .slots = mpu_slots, .period = 2 };
+	static twi_sample_t mag_sample = { .params = { .slave_addr = 0x1E, .tx_prefix = {0x03}, .tx_prefix_count = 1, .rx_count = 6 },
+									   .slots = mag_slots, .period = 2 };
+	static const int16_t zero[3];
+	twi_sim_stats_t stats;
+	uint8_t buf[14];
+	uint8_t seq;
+
+	twi_sim_mpu6050_init(&_mpu, 0x68);
+	twi_sim_hmc5883_init(&_mag);
+	TWI_Sampler_Add(&mpu_sample);
+	TWI_Sampler_Add(&mag_sample);
+	TWI_Sampler_Start();
+	twi_sim_mpu6050_set_sample(&_mpu, zero, 25, zero);
+	twi_sim_hmc5883_set_sample(&_mag, 7, 8, 9);
+
+	/* Both samples due on the same tick: the second is started by the callback of the first */
+	twi_sim_stats_reset();
+	TWI_Sampler_Tick();
+	TWI_Sampler_Tick();
+	_delay_ms(1);
+	twi_sim_stats_get(&stats);
+	CHECK(stats.stops == 2);
+	CHECK(stats.rep_starts == 2);	/* One per read, none between the samples */
+	CHECK(TWI_Sampler_Read(&mpu_sample, buf, &seq) == TWI_STATUS_DONE && seq == 1);
+	CHECK(buf[7] == 25);
+	CHECK(TWI_Sampler_Read(&mag_sample, buf, &seq) == TWI_STATUS_DONE && seq == 1);
+	CHECK(buf[1] == 7);
+
+	/* First sample fails with lost arbitration: the chained one still completes */
+	twi_sim_lose_arbitration(TWI_ARB_RETRIES + 1);
+	TWI_Sampler_Tick();
+	TWI_Sampler_Tick();
+	_delay_ms(1);
+	CHECK(TWI_Master_Status() != TWI_STATUS_BUSY);
+	CHECK((mpu_sample.status == TWI_STATUS_ARBLOST) != (mag_sample.status == TWI_STATUS_ARBLOST));
+	CHECK(mpu_sample.seq + mag_sample.seq == 3);
+
+	TWI_Sampler_Stop();
+}
+
+
+#if TWI_STATS_ENABLED
+/* Transfer counts by status, and latency bin of a transfer of known duration (TCNT1 counts F_CPU cycles) */
+static void test_stats(void)
+{
+	uint8_t reg = 0x03;
+	uint8_t buf[6];
+	twi_params_t write = { .slave_addr = 0x1E, .tx_buf = &reg, .tx_count = 1 };
+	twi_params_t read = { .slave_addr = 0x1E, .tx_prefix = {0x03}, .tx_prefix_count = 1, .rx_buf = buf, .rx_count = 6 };
+	twi_params_t absent = { .slave_addr = 0x68, .tx_buf = &reg, .tx_count = 1 };
+	twi_stats_t stats;
+	uint64_t cycles;
+
+	twi_sim_hmc5883_init(&_mag);
+	TWI_Stats_Reset();
+
+	/* START, SLA+W and one byte at 410kHz: 19 SCL periods and the interrupts, 512 to 1023 cycles */
+	cycles = sim_cycles();
+	CHECK(TWI_Master_Transfer(&write) == TWI_STATUS_DONE);
+	cycles = sim_cycles() - cycles;
+	CHECK(cycles >= 512 && cycles < 1024);
+	TWI_Stats_Get(&stats);
+	CHECK(stats.transfers == 1 && stats.bytes == 1);
+	CHECK(stats.latency[9] == 1);
+
+	CHECK(TWI_Master_Transfer(&read) == TWI_STATUS_DONE);
+	CHECK(TWI_Master_Transfer(&absent) == TWI_STATUS_NOACK);
+#if !TWI_SLEEP_WAIT || TWI_SLEEP_TIMEOUT_TICKS
+	_mag.dev.hang = 1;
+	CHECK(TWI_Master_Transfer(&read) == TWI_STATUS_TIMEOUT);
+#endif
+	TWI_Stats_Get(&stats);
+	CHECK(stats.bytes == 1 + 7);
+	CHECK(stats.nacks == 1 && stats.bus_errors == 0 && stats.arb_lost == 0);
+#if !TWI_SLEEP_WAIT || TWI_SLEEP_TIMEOUT_TICKS
+	CHECK(stats.transfers == 4 && stats.timeouts == 1);
+#else
+	CHECK(stats.transfers == 3 && stats.timeouts == 0);
+#endif
+
+	TWI_Stats_Reset();
+	TWI_Stats_Get(&stats);
+	CHECK(stats.transfers == 0 && stats.latency[9] == 0);
+}
+#endif
+
+
+/* HMC5883 moved to the pin-level bus of soft_twi (PC0, PC1 of soft_twi_config.h) */
+static void soft_setup(void)
+{
+	twi_sim_pins_init(&_soft_bus, &DDRC, &PINC, 0, 1);
+	twi_sim_hmc5883_init(&_mag);
+	twi_sim_detach(&_mag.dev);
+	twi_sim_pins_attach(&_soft_bus, &_mag.dev);
+	SoftTWI_Init();
+}
+
+
+static void test_soft(void)
+{
+	uint8_t buf[6];
+	twi_params_t params = { .slave_addr = 0x1E, .tx_prefix = {0x03}, .tx_prefix_count = 1, .rx_buf = buf, .rx_count = 6 };
+
+	soft_setup();
+	twi_sim_hmc5883_set_sample(&_mag, 1, 2, 3);
+	CHECK(SoftTWI_Master_Transfer(&params) == TWI_STATUS_DONE);
+	CHECK(buf[1] == 1 && buf[3] == 3 && buf[5] == 2);
+	CHECK(_soft_bus.starts == 2 && _soft_bus.stops == 1 && _soft_bus.bytes == 7);
+	/* The code takes no time on the host: Fast mode timing is met by the delays alone */
+	CHECK(_soft_bus.scl_low_min_ns >= 1300 && _soft_bus.scl_high_min_ns >= 600);
+
+	CHECK(!SoftTWI_Device_Present(0x68));
+	CHECK(SoftTWI_Device_Present(0x1E));
+	CHECK(_soft_bus.stops == 3);
+}
+
+
+/* Device holding SCL low before each ACK */
+static void test_soft_stretch(void)
+{
+	uint8_t buf[6];
+	twi_params_t params = { .slave_addr = 0x1E, .tx_prefix = {0x03}, .tx_prefix_count = 1, .rx_buf = buf, .rx_count = 6 };
+	uint64_t t;
+
+	soft_setup();
+	twi_sim_hmc5883_set_sample(&_mag, 1, 2, 3);
+	_soft_bus.stretch_ns = 50000;
+	t = sim_now_ns();
+	CHECK(SoftTWI_Master_Transfer(&params) == TWI_STATUS_DONE);
+	CHECK(sim_now_ns() - t >= 3 * 50000);	/* SLA+W, register, SLA+R */
+	CHECK(buf[1] == 1 && buf[3] == 3 && buf[5] == 2);
+
+#if TWI_TIMEOUT_US
+	_soft_bus.stretch_ns = 4000ULL * TWI_TIMEOUT_US;
+	CHECK(SoftTWI_Master_Transfer(&params) == TWI_STATUS_TIMEOUT);
+	CHECK(!(DDRC & 0x03));	/* Lines released */
+#endif
+}
+
+
+/* Another master starting at the same time, with a lower address (wins) or a higher one (loses) */
+static void test_soft_arbitration(void)
+{
+	uint8_t buf[6];
+	twi_params_t params = { .slave_addr = 0x1E, .tx_prefix = {0x03}, .tx_prefix_count = 1, .rx_buf = buf, .rx_count = 6 };
+
+	soft_setup();
+	_soft_bus.rival = 0x08 << 1;
+	CHECK(SoftTWI_Master_Transfer(&params) == TWI_STATUS_ARBLOST);
+	CHECK(!(DDRC & 0x03));
+	/* Bus still used by the other master : no START */
+	CHECK(SoftTWI_Master_Transfer(&params) == TWI_STATUS_BUSERROR);
+	CHECK(_soft_bus.starts == 1);
+	_delay_us(50);
+	CHECK(_soft_bus.stops == 1);
+	CHECK(SoftTWI_Master_Transfer(&params) == TWI_STATUS_DONE);
+
+	_soft_bus.rival = 0x7F << 1;
+	CHECK(SoftTWI_Master_Transfer(&params) == TWI_STATUS_DONE);
+	CHECK(_soft_bus.rival == 0);
+}
+
+
+/* AVR as slave, addressed by the external master of the simulated bus. Last test: slave mode stays enabled */
+static void test_slave(void)
+{
+	static volatile uint8_t regs[8];
+	uint8_t tx[3];
+	uint8_t rx[3];
+
+	twi_sim_hmc5883_init(&_mag);
+	CHECK(TWI_Slave_Init(0x30, regs, 0, 0) == 1);
+	CHECK(TWI_Slave_Init(0x30, regs, 8, 9) == 1);
+	CHECK(twi_sim_host_transfer(0x30, 0, 0, rx, 1) == -1);	/* Not enabled */
+	CHECK(TWI_Slave_Init(0x30, regs, 8, 4) == 0);
+	CHECK(twi_sim_host_transfer(0x31, 0, 0, rx, 1) == -1);
+
+	/* Pointer, then registers from the pointer */
+	tx[0] = 1; tx[1] = 0xA1; tx[2] = 0xA2;
+	CHECK(twi_sim_host_transfer(0x30, tx, 3, 0, 0) == 3);
+	CHECK(regs[1] == 0xA1 && regs[2] == 0xA2);
+	CHECK(TWI_Slave_Written());
+	CHECK(!TWI_Slave_Written());
+
+	/* Read after repeated START wraps to register 0, and the next read continues from the pointer */
+	regs[0] = 0x10; regs[6] = 0x66; regs[7] = 0x77;
+	tx[0] = 6;
+	CHECK(twi_sim_host_transfer(0x30, tx, 1, rx, 3) == 1);
+	CHECK(rx[0] == 0x66 && rx[1] == 0x77 && rx[2] == 0x10);
+	CHECK(twi_sim_host_transfer(0x30, 0, 0, rx, 1) == 0);
+	CHECK(rx[0] == 0xA1);
+	CHECK(!TWI_Slave_Written());
+
+	/* Read-only register : the byte is NACKed and ignored */
+	tx[0] = 3; tx[1] = 0xB3; tx[2] = 0xB4;
+	CHECK(twi_sim_host_transfer(0x30, tx, 3, 0, 0) == 2);
+	CHECK(regs[3] == 0xB3 && regs[4] == 0);
+	tx[0] = 5;
+	CHECK(twi_sim_host_transfer(0x30, tx, 2, 0, 0) == 1);
+	CHECK(regs[5] == 0);
+
+	/* Out of range pointer : data NACKed, pointer reset to 0 */
+	tx[0] = 8; tx[1] = 0xC0;
+	CHECK(twi_sim_host_transfer(0x30, tx, 2, 0, 0) == 1);
+	CHECK(twi_sim_host_transfer(0x30, 0, 0, rx, 1) == 0);
+	CHECK(rx[0] == 0x10);
+
+	/* Write wraps to register 0 when all are writable */
+	CHECK(TWI_Slave_Init(0x30, regs, 8, 8) == 0);
+	tx[0] = 7; tx[1] = 0xD7; tx[2] = 0xD0;
+	CHECK(twi_sim_host_transfer(0x30, tx, 3, 0, 0) == 3);
+	CHECK(regs[7] == 0xD7 && regs[0] == 0xD0);
+
+	/* Master transfers still work between slave transactions */
+	CHECK(TWI_Device_Present(0x1E));
+	CHECK(twi_sim_host_transfer(0x30, 0, 0, rx, 1) == 0);
+}
+
+
+static const struct {
+	const char	*name;
+	void		(*run)(void);
+} _tests[] = {
+	{ "ds3231", test_ds3231 },
+	{ "mpu6050", test_mpu6050 },
+	{ "hmc5883", test_hmc5883 },
+	{ "ssd1306", test_ssd1306 },
+	{ "missing device", test_missing_device },
+	{ "timeout", test_timeout },
+	{ "arbitration", test_arbitration },
+	{ "sampler", test_sampler },
+#if TWI_STATS_ENABLED
+	{ "stats", test_stats },
+#endif
+	{ "soft", test_soft },
+	{ "soft stretch", test_soft_stretch },
+	{ "soft arbitration", test_soft_arbitration },
+	{ "slave", test_slave },
+};
+
+
+int main(void)
+{
+	unsigned i;
+	unsigned failures;
+
+	for(i = 0; i < sizeof(_tests) / sizeof(_tests[0]); i++) {
+		failures = _failures;
+		test_setup();
+		_tests[i].run();
+		printf("%-16s %s\n", _tests[i].name, (_failures == failures) ? "ok" : "FAILED");
+	}
+	return _failures ? 1 : 0;
+}
@@ -23,6 +23,10 @@ uint8_t mpu6050_init(uint8_t mode)
 	
 	/* Initialize AVR TWI bus */
 	TWI_Init();
+	/* Skip init sequence if device is missing */
+	if(!TWI_Device_Present(SLA_ADDR)) {
+		return TWI_STATUS_NOACK;
+	}
 	
 	params.slave_addr = SLA_ADDR;
 	/* Disable sleep mode */
@@ -77,11 +81,10 @@ uint8_t mpu6050_init(uint8_t mode)
 uint8_t mpu6050_get_data(uint8_t *buf, uint8_t count)
 {
 	twi_params_t  	params = {0};
-	uint8_t 		tx_data = 0x3B;
 	
 	params.slave_addr = SLA_ADDR;
-	params.tx_buf = &tx_data;
-	params.tx_count = 1;
+	params.tx_prefix[0] = 0x3B;	/* Data registers start at 0x3B */
+	params.tx_prefix_count = 1;
 	params.rx_buf = buf;
 	params.rx_count = count;
 	
@@ -17,6 +17,7 @@
  *     MPU6050_LOW_POWER_ACCEL_MODE: Only accelerometer is enabled
  * Returns:
  * 	   0 - success
+ * 	   TWI_STATUS_NOACK - Device not present on the bus (init sequence not sent)
  * 	   1 - Error
  */
 uint8_t mpu6050_init(uint8_t mode);
@@ -68,12 +68,58 @@ typedef enum {
 
 
 
+/**
+ * \brief	Counters of packets sent with rf24_queue_packet() (see rf24_tx_poll())
+ */
+typedef struct {
+	uint8_t  in_flight;		//!< Packets written to the Tx FIFO and not yet completed
+	uint16_t sent;			//!< Packets sent (ACK received, or sent without ACK)
+	uint16_t failed;		//!< Packets dropped: failed after all retransmits, or flushed with it
+} rf24_tx_counters_t;
+
+
+
+
+/**
+ * \brief	Runtime configuration (see rf24_apply_config(), needs CONFIG_RF24_RUNTIME_CONFIG)
+ * \details	Same settings as the CONFIG_RF24_* macros of rf24_config.h. rf24_get_config() and rf24_apply_config()
+ * 			are declared when CONFIG_RF24_RUNTIME_CONFIG is defined to 1 before this file is included (include
+ * 			rf24_config.h first).
+ */
+typedef struct {
+	uint8_t channel;			//!< RF channel (0 - 125)
+	uint8_t rate;				//!< Data rate (\ref rf24_datarate_t)
+	uint8_t power;				//!< Transmit power (\ref rf24_power_t)
+	uint8_t addr_len;			//!< Address width (3 - 5)
+	uint8_t autoack;			//!< 1 to enable Auto-Acknowledgement and retransmits
+	uint8_t retransmits;		//!< Number of retransmits (0 - 15)
+	uint8_t dynamic_payload;	//!< 1 to enable dynamic payload length
+	uint8_t payload_length;		//!< Static payload length of Pipe 0 and Pipe 1 (0 - 32)
+	uint8_t ack_payload;		//!< 1 to enable ACK payloads (needs dynamic_payload)
+	uint8_t ack_payload_length;	//!< Maximum ACK payload length, for the retransmit delay (0 - 32)
+} rf24_config_t;
+
+
+
+
 /*----------------- PUBLIC FUNCTIONS -----------------*/
 
 uint8_t rf24_init(rf24_opmode_t mode, const uint8_t *address);
+uint8_t rf24_recover(void);
+#if CONFIG_RF24_RUNTIME_CONFIG
+void 	rf24_get_config(rf24_config_t *config);
+uint8_t rf24_apply_config(const rf24_config_t *config);
+#endif
 void 	rf24_set_address(rf24_pipe_t pipe, const uint8_t *addr);
+uint8_t rf24_open_pipe(rf24_pipe_t pipe, const uint8_t *addr, uint8_t length, uint8_t autoack);
+uint8_t rf24_close_pipe(rf24_pipe_t pipe);
 uint8_t rf24_transmit_packet(const uint8_t* pbuf, uint8_t len);
 uint8_t rf24_transmit_packet_noack(const uint8_t *packet, uint8_t length);
+uint8_t rf24_queue_packet(const uint8_t *packet, uint8_t length, rf24_payload_t type);
+uint8_t rf24_tx_poll(rf24_tx_counters_t *counters);
+void 	rf24_stream_begin(rf24_payload_t type);
+uint8_t rf24_stream_write(const uint8_t *packet, uint8_t length);
+uint8_t rf24_stream_end(rf24_tx_counters_t *counters);
 uint8_t rf24_receive_packet(uint8_t* pbuf, uint8_t* length);
 void 	rf24_set_ack_payload(uint8_t pipe, const uint8_t *buf, uint8_t length);
 void 	rf24_powerdown(void);
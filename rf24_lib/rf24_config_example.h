@@ -23,6 +23,17 @@
 #define CE_PIN   	1
 
 
+/**
+ * \brief	(Optional) Define which AVR pin is connected to the RF module CSN, and the SPI clock rate
+ * \details	CSN defaults to the SS pin of spi_config.h, clock rate to SPI_CLKDIV_4. Other devices can share
+ *			the SPI bus with their own mode and clock rate (see SPI_Device_Init() in avr_spi.h)
+ */
+//#define CONFIG_RF24_CSN_PORT		PORTB
+//#define CONFIG_RF24_CSN_DDR		DDRB
+//#define CONFIG_RF24_CSN_PIN		2
+//#define CONFIG_RF24_SPI_CLKDIV	SPI_CLKDIV_4
+
+
 
 /*-----------------POLLED/INTERRUPT MODE --------------------*/
 /**
@@ -34,6 +45,41 @@
 
 
 
+/*-----------------RECEIVE QUEUE --------------------*/
+/**
+ * \brief	(Optional) Number of received packets queued in RAM (default: 0, no queue)
+ * \details	The Rx FIFO of the module is drained into the queue by the IRQ handler (or each rf24_receive_packet()
+ *			call in polled mode), so that bursts of packets are kept until the application reads them. Each entry
+ *			takes 34 bytes of RAM.
+ */
+//#define CONFIG_RF24_RX_QUEUE_DEPTH		4
+
+
+
+/*-----------------TRANSMIT TIMEOUT --------------------*/
+/**
+ * \brief	(Optional) Maximum time (ms) to wait for the end of a transmission, 0 to wait forever (default: 0)
+ * \details	On timeout the transmit functions return 3 after recovering the module (rf24_recover()). Define
+ *			CONFIG_RF24_TICK_MS() to a millisecond counter of the project to measure it. Otherwise the polls are
+ *			counted, with a 10 us delay between them which delays the end of each transmission by up to 10 us.
+ */
+//#define CONFIG_RF24_TX_TIMEOUT_MS		100
+//#define CONFIG_RF24_TICK_MS()			millis()
+
+
+
+/*-----------------RUNTIME CONFIGURATION --------------------*/
+/**
+ * \brief	(Optional) Define to 1 to change the configuration at runtime (default: 0)
+ * \details	The settings below (channel, data rate, power, address width, auto-ack, retransmits and payload
+ *			options) are then the defaults of an rf24_config_t, changed with rf24_get_config() and
+ *			rf24_apply_config(). With 0 they are build-time constants. Include this file before rf24.h to
+ *			have these functions declared.
+ */
+//#define CONFIG_RF24_RUNTIME_CONFIG		1
+
+
+
 /*----------------- FOR RFM7x Modules ONLY -----------------*/
 /**
  * \brief	Define to 1 if RFM70/RFM73/RFM75 module is used. 
@@ -52,6 +98,12 @@
 #define CONFIG_RF24_ADDRESS		{0x11, 0x22, 0x33, 0x44, 0x55}
 #define CONFIG_RF24_ADDR_LEN		5
 
+/**
+ * \brief	(Optional) Address of Pipe 1 opened by rf24_init() (default: 0xC2 bytes)
+ * \details	Pipes 2 - 5, opened with rf24_open_pipe(), share its bytes except the LSByte
+ */
+//#define CONFIG_RF24_PIPE1_ADDR	{0xC2, 0xC2, 0xC2, 0xC2, 0xC2}
+
 
 
  
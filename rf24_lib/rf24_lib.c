@@ -12,7 +12,7 @@
  *			| SCK				| SCK(PB5)	|
  *			| MISO				| MISO(PB4)	|
  *			| MOSI				| MOSI(PB3)	|
- *			| CSN				| SS#(PB2)	|  Changeable in spi_config.h
+ *			| CSN				| SS#(PB2)	|  Changeable in rf24_config.h (default: SS pin of spi_config.h)
  *			| CE				| PB1		|  Changeable in rf24_config.h
  *			| IRQ				| INT1(PD3)	|  This driver uses INT1 AVR interrupt
  *			| VCC				| VCC(3.3V) |
@@ -21,9 +21,12 @@
  *	@note	IRQ interrupt from RF module is used - If AVR sleep mode is used, this will reduce power consumption when RF module is used in Rx mode.
  * 			The software can chose Interrupt or Polled mode. In case of polled mode, RF module IRQ pin can be left unconnected
  * 			if interrupt mode is used, IRQ pin should be connected to INT1 of AVR.
+ *			On ATtiny parts without SPI module, select SPI_BACKEND_USI or SPI_BACKEND_SOFT in spi_config.h
+ *			(see avr_spi.h) and use polled mode.
  *
  *
- *	@todo	Handle complexities of Multiceiver configuration
+ *			rf24_init() opens Pipe 0 (address of the radio) and Pipe 1. Up to six pipes (Multiceiver) are
+ *			opened and closed at runtime with rf24_open_pipe() and rf24_close_pipe().
  *
  *
  *	@author	Visakhan C
@@ -37,20 +40,74 @@
 #include "avr_spi.h"
 
 #include "rf24_reg.h"
-#include "rf24.h"
 
-/* rf24_config.h is project specific specific and should be present in the project directory */
+/* rf24_config.h is project specific specific and should be present in the project directory.
+ * Included before rf24.h, which declares rf24_get_config()/rf24_apply_config() with CONFIG_RF24_RUNTIME_CONFIG */
 #include "rf24_config.h"
+#include "rf24.h"
 
 //#define LED_DEBUG
 
-#define CSN_LOW()	SS_LOW()
-#define CSN_HIGH()	SS_HIGH()
+/* CSN pin defaults to the SS pin of spi_config.h */
+#if !defined CONFIG_RF24_CSN_PORT
+	#if defined ALT_SS_PORT
+	#define CONFIG_RF24_CSN_PORT	ALT_SS_PORT
+	#define CONFIG_RF24_CSN_DDR		ALT_SS_DDR
+	#define CONFIG_RF24_CSN_PIN		ALT_SS_BIT
+	#else
+	#define CONFIG_RF24_CSN_PORT	SPI_PORT
+	#define CONFIG_RF24_CSN_DDR		SPI_DDR
+	#define CONFIG_RF24_CSN_PIN		SS_BIT
+	#endif
+#endif
+
+#if !defined CONFIG_RF24_SPI_CLKDIV
+#define CONFIG_RF24_SPI_CLKDIV	SPI_CLKDIV_4
+#endif
+
+/* SPI mode and clock of the module are set on each access, if another device used the bus in between */
+#define CSN_LOW()	SPI_Acquire(&rf24_spi)
+#define CSN_HIGH()	SPI_Release(&rf24_spi)
+
+/* IRQ pin interrupt (INT1) mask */
+#if defined EIMSK
+#define RF24_INT_ENABLE()	(EIMSK |= (1 << INT1))
+#define RF24_INT_DISABLE()	(EIMSK &= ~(1 << INT1))
+#else
+#define RF24_INT_ENABLE()	(GICR |= (1 << INT1))
+#define RF24_INT_DISABLE()	(GICR &= ~(1 << INT1))
+#endif
 
 #define CE_OUT()	(CE_DDR |= (1 << CE_PIN))
 #define CE_LOW()	(CE_PORT &= ~(1 << CE_PIN))
 #define CE_HIGH()	(CE_PORT |= (1 << CE_PIN))
 
+/* Depth of the queue of received packets (34 bytes each), drained from the Rx FIFO by the IRQ handler.
+ * 0: no queue, rf24_receive_packet() reads the Rx FIFO */
+#if !defined CONFIG_RF24_RX_QUEUE_DEPTH
+#define CONFIG_RF24_RX_QUEUE_DEPTH	0
+#endif
+
+/* Transmit timeout (ms), 0 (default) to wait forever. Measured with CONFIG_RF24_TICK_MS(), a millisecond counter
+ * of the project (eg: #define CONFIG_RF24_TICK_MS() millis()), or else by counting 10 us delays between polls:
+ * the end of transmission is then seen up to 10 us late, and the SPI time of each poll makes the actual timeout
+ * longer */
+#if !defined CONFIG_RF24_TX_TIMEOUT_MS
+#define CONFIG_RF24_TX_TIMEOUT_MS	0
+#endif
+
+#if defined CONFIG_RF24_TICK_MS
+#define RF24_DEADLINE_INIT()	uint16_t deadline_start = (uint16_t)CONFIG_RF24_TICK_MS()
+#define RF24_DEADLINE_PASSED()	((uint16_t)((uint16_t)CONFIG_RF24_TICK_MS() - deadline_start) >= CONFIG_RF24_TX_TIMEOUT_MS)
+#else
+#define RF24_DEADLINE_INIT()	uint32_t deadline_polls = 0
+#define RF24_DEADLINE_PASSED()	(_delay_us(10), ++deadline_polls >= (CONFIG_RF24_TX_TIMEOUT_MS * 100UL))
+#endif
+
+/* Maximum continuous time in TX mode (nRF24L01+), and TX settling time */
+#define RF24_TX_MODE_MAX_US		4000
+#define RF24_TX_SETTLE_US		130
+
 #define CE_PULSE() CE_HIGH(); \
 	_delay_us(20); \
 	CE_LOW();
@@ -93,39 +150,106 @@
 #error "CONFIG_RF24_TX_RETRANSMITS not defined - modify in rf24_config.h"
 #endif
 
-/* Auto Retransmission delay (us) */
-#if (CONFIG_RF24_DATA_RATE == RF24_RATE_250KBPS)
-	#if (CONFIG_RF24_ACK_PL_ENABLED) /* ACK with payload */
-		#if (CONFIG_RF24_ACK_PL_LENGTH < 8)
-		#define CONFIG_RF24_RETRANS_DELAY 800
-		#elif (CONFIG_RF24_ACK_PL_LENGTH < 16)
-		#define CONFIG_RF24_RETRANS_DELAY 1100
-		#elif (CONFIG_RF24_ACK_PL_LENGTH < 24)
-		#define CONFIG_RF24_RETRANS_DELAY 1300
-		#else
-		#define CONFIG_RF24_RETRANS_DELAY 1600
-		#endif
-	#else
-		#define CONFIG_RF24_RETRANS_DELAY 700  /* Empty ACK */
-	#endif
-#else /* 1Mbps or 2Mbps */
-	#if (CONFIG_RF24_ACK_PL_ENABLED) /* ACK with payload */
-		#define CONFIG_RF24_RETRANS_DELAY 700
-	#else /* Empty ACK */
-		#define CONFIG_RF24_RETRANS_DELAY 300
-	#endif
+/* Optional settings, for the default configuration */
+#if !defined CONFIG_RF24_ACK_PL_ENABLED
+#define CONFIG_RF24_ACK_PL_ENABLED	0
+#endif
+
+#if !defined CONFIG_RF24_ACK_PL_LENGTH
+#define CONFIG_RF24_ACK_PL_LENGTH	0
 #endif
 
-/*  This is the Pipe1 address to be configured for PRX device
- TODO: Address assignment is rudimentary now. Needs work on assigning dynamic address to all 6 pipes at runtime  */
+#if !defined CONFIG_RF24_TX_RETRANSMITS
+#define CONFIG_RF24_TX_RETRANSMITS	0
+#endif
+
+/* 1: the configuration can be changed at runtime with rf24_apply_config(), starting from the CONFIG_RF24_* macros.
+ * 0: the macros are used as constants */
+#if !defined CONFIG_RF24_RUNTIME_CONFIG
+#define CONFIG_RF24_RUNTIME_CONFIG	0
+#endif
+
+/* Setting of the configuration (field of rf24_config_t) */
+#if CONFIG_RF24_RUNTIME_CONFIG
+#define RF24_CFG(field)				(rf24_cfg.field)
+#define RF24_ADDR_SIZE				5
+#else
+#define RF24_CFG(field)				RF24_CFG_##field
+#define RF24_CFG_channel			CONFIG_RF24_RF_CHANNEL
+#define RF24_CFG_rate				CONFIG_RF24_DATA_RATE
+#define RF24_CFG_power				CONFIG_RF24_TX_PWR
+#define RF24_CFG_addr_len			CONFIG_RF24_ADDR_LEN
+#define RF24_CFG_autoack			CONFIG_RF24_AUTOACK_ENABLED
+#define RF24_CFG_retransmits		CONFIG_RF24_TX_RETRANSMITS
+#define RF24_CFG_dynamic_payload	CONFIG_RF24_DYNAMIC_PL_ENABLED
+#define RF24_CFG_payload_length		CONFIG_RF24_STATIC_PL_LENGTH
+#define RF24_CFG_ack_payload		CONFIG_RF24_ACK_PL_ENABLED
+#define RF24_CFG_ack_payload_length	CONFIG_RF24_ACK_PL_LENGTH
+#define RF24_ADDR_SIZE				CONFIG_RF24_ADDR_LEN
+#endif
+
+/*  This is the Pipe1 address configured by rf24_init(). Pipes 2 - 5 share its bytes except the LSByte
+ (see rf24_open_pipe) */
+#ifndef CONFIG_RF24_PIPE1_ADDR
 #define CONFIG_RF24_PIPE1_ADDR 	{0xC2, 0xC2, 0xC2, 0xC2, 0xC2}
+#endif
 
 static volatile bool tx_done;
 static volatile bool rx_ready;
 static volatile bool max_retries;
+static volatile uint8_t tx_in_flight;	/* Packets queued by rf24_queue_packet() */
+static volatile uint16_t tx_sent;
+static volatile uint16_t tx_failed;
+#if !CONFIG_RF24_POLLED_MODE
+static volatile bool irq_hold;			/* IRQ masked by the main program, not to be unmasked by rf24_irq_unmask() */
+#endif
+static rf24_payload_t stream_type;
+static uint16_t stream_air_us;			/* TX mode time of the packets written since the radio entered TX mode */
+static uint16_t stream_failed;			/* tx_failed at rf24_stream_begin() */
 static uint8_t pipe1_addr[] = CONFIG_RF24_PIPE1_ADDR;
+#if CONFIG_RF24_RX_QUEUE_DEPTH
+/* Received packets, drained from the Rx FIFO by rf24_irq() */
+typedef struct {
+    uint8_t len;
+    uint8_t pipe;
+    uint8_t payload[32];
+} rf24_rx_entry_t;
+
+static rf24_rx_entry_t rx_queue[CONFIG_RF24_RX_QUEUE_DEPTH];
+static volatile uint8_t rx_head;
+static volatile uint8_t rx_count;
+
+static void rf24_rx_drain(uint8_t status);
+#endif
+/* Copy of the configuration registers (CONFIG to RF_SETUP, RX_PW_P0 to RX_PW_P5, DYNPD, FEATURE) kept by
+ rf24_write_reg(), so that mode switches are single writes. Set again by rf24_configure(), after a reset of the module */
+static uint8_t rf24_shadow[RF_SETUP + 9];
+#define RF24_SHADOWED(reg)		(((reg) <= RF_SETUP) || (((reg) >= RX_PW_P0) && ((reg) <= RX_PW_P5)) \
+								|| ((reg) == DYNPD) || ((reg) == FEATURE))
+#define RF24_SHADOW(reg)		rf24_shadow[((reg) <= RF_SETUP) ? (reg) : \
+								((reg) <= RX_PW_P5) ? ((reg) - RX_PW_P0 + RF_SETUP + 1) : ((reg) - DYNPD + RF_SETUP + 7)]
+static rf24_opmode_t rf24_mode;			/* Mode and address given to rf24_init(), for recovery */
+static uint8_t rf24_address[RF24_ADDR_SIZE];
+#if CONFIG_RF24_RUNTIME_CONFIG
+static rf24_config_t rf24_cfg = {
+    .channel = CONFIG_RF24_RF_CHANNEL,
+    .rate = CONFIG_RF24_DATA_RATE,
+    .power = CONFIG_RF24_TX_PWR,
+    .addr_len = CONFIG_RF24_ADDR_LEN,
+    .autoack = CONFIG_RF24_AUTOACK_ENABLED,
+    .retransmits = CONFIG_RF24_TX_RETRANSMITS,
+    .dynamic_payload = CONFIG_RF24_DYNAMIC_PL_ENABLED,
+    .payload_length = CONFIG_RF24_STATIC_PL_LENGTH,
+    .ack_payload = CONFIG_RF24_ACK_PL_ENABLED,
+    .ack_payload_length = CONFIG_RF24_ACK_PL_LENGTH,
+};
+static bool rf24_initialized;
+#endif
+static spi_device_t rf24_spi;
 
-static void rf24_irq(void);
+static uint8_t rf24_irq(void);
+static uint8_t rf24_handle_status(uint8_t status);
+static uint8_t rf24_configure(void);
 
 #ifdef LED_DEBUG
 #define DBG_LED					PD6
@@ -168,33 +292,41 @@ const uint8_t Bank1_Reg14[]=
 
 static void mcu_init(void) {
     CE_OUT();
-    SPI_Init(SPI_MODE0, SPI_CLKDIV_4);  // SPI_CLKDIV_4
+    SPI_Init(SPI_MODE0, CONFIG_RF24_SPI_CLKDIV);
+    SPI_Device_Init(&rf24_spi, SPI_MODE0, CONFIG_RF24_SPI_CLKDIV,
+                    &CONFIG_RF24_CSN_PORT, &CONFIG_RF24_CSN_DDR, CONFIG_RF24_CSN_PIN);
 
 #if !CONFIG_RF24_POLLED_MODE /* configure INT1 as LOW-level triggered */
 
 #if defined  EICRA 
     EICRA &= ~((1 << ISC10)|(1 << ISC11));
-    EIMSK |= (1 << INT1);
 #else
     MCUCR &= ~((1 << ISC11) | (1 << ISC10));
-    GICR |= (1 << INT1);
 #endif
+    RF24_INT_ENABLE();
 
 #endif
 }
 
-/* Reads from a register */
-static uint8_t rf24_read_reg(uint8_t reg) {
+/* Reads from a register. The STATUS register, clocked out with the command byte, is returned in *status */
+static uint8_t rf24_read_reg_status(uint8_t reg, uint8_t *status) {
     uint8_t value;
 
     CSN_LOW();
-    SPI_TxRx(reg); /* Transmit register to read */
+    *status = SPI_TxRx(reg); /* Transmit register to read */
     value = SPI_TxRx(0); /* Then get the register value */
     CSN_HIGH();
 
     return value;
 }
 
+/* Reads from a register */
+static inline uint8_t rf24_read_reg(uint8_t reg) {
+    uint8_t status;
+
+    return rf24_read_reg_status(reg, &status);
+}
+
 /* Writes to a register */
 static uint8_t rf24_write_reg(uint8_t reg, uint8_t val) {
     uint8_t status;
@@ -203,6 +335,9 @@ static uint8_t rf24_write_reg(uint8_t reg, uint8_t val) {
     if (reg < WRITE_REG) { /* write register with data */
         status = SPI_TxRx(WRITE_REG | reg);
         SPI_TxRx(val);
+        if (RF24_SHADOWED(reg)) {
+            RF24_SHADOW(reg) = val;
+        }
     } else { /* command with (optional) data */
         status = SPI_TxRx(reg);
         if (val) {
@@ -231,12 +366,8 @@ static inline uint8_t rf24_nop(void) {
     return rf24_write_reg(NOP, 0);
 }
 
-static inline uint8_t rf24_get_rx_pipe(void) {
-    return ((rf24_write_reg(NOP, 0) >> 1) & 0x7);
-}
-
 static inline uint8_t rf24_get_address_width(void) {
-    return (rf24_read_reg(SETUP_AW) + 2);
+    return (RF24_SHADOW(SETUP_AW) + 2);
 }
 
 #if RFM7x_INIT
@@ -289,6 +420,119 @@ void rf24_set_address(rf24_pipe_t pipe, const uint8_t *addr) {
 
 }
 
+/**
+ * \brief	Opens a receive pipe (Multiceiver: up to 6 pipes)
+ * \details	Pipes 0 and 1 have their own address, of the address width (3 - 5 bytes). Pipes 2 - 5 share the
+ * 			bytes of the Pipe 1 address except the LSByte, given as a single byte (*addr). In PTX mode, Pipe 0
+ * 			receives the ACKs, and should keep the Tx address while auto-ack is used.
+ * 			Packets received on the pipe are returned by rf24_receive_packet() with the pipe number.
+ * 			In Rx mode, the radio is put in Standby-I while the pipe is configured.
+ * \param 	pipe - Pipe number, RF24_PIPE0 to RF24_PIPE5
+ * \param 	addr - address of the pipe (see above), or NULL to keep the current one
+ * \param 	length - static payload length (1 - 32), or 0 for dynamic payload length (needs dynamic payload
+ * 			length enabled in the configuration, and autoack)
+ * \param 	autoack - 1 to acknowledge the packets received on the pipe, 0 otherwise
+ * \return	0 - Pipe opened
+ * 			1 - Invalid parameter
+ */
+uint8_t rf24_open_pipe(rf24_pipe_t pipe, const uint8_t *addr, uint8_t length, uint8_t autoack) {
+    uint8_t mask = (1 << pipe);
+
+    if ((pipe > RF24_PIPE5) || (length > 32)) {
+        return 1;
+    }
+    if ((length == 0) && (!RF24_CFG(dynamic_payload) || !autoack)) {
+        return 1;
+    }
+    CE_LOW();
+    if (addr) {
+        rf24_set_address(pipe, addr);
+    }
+    rf24_write_reg(RX_PW_P0 + pipe, length ? length : 32);
+    rf24_write_reg(EN_AA, autoack ? (RF24_SHADOW(EN_AA) | mask) : (RF24_SHADOW(EN_AA) & ~mask));
+    rf24_write_reg(DYNPD, length ? (RF24_SHADOW(DYNPD) & ~mask) : (RF24_SHADOW(DYNPD) | mask));
+    rf24_write_reg(EN_RXADDR, RF24_SHADOW(EN_RXADDR) | mask);
+    if (rf24_mode == RF24_MODE_PRX) {
+        CE_HIGH();
+    }
+
+    return 0;
+}
+
+/**
+ * \brief	Closes a receive pipe opened by rf24_init() or rf24_open_pipe()
+ * \param 	pipe - Pipe number, RF24_PIPE0 to RF24_PIPE5
+ * \return	0 - Pipe closed
+ * 			1 - Invalid parameter
+ */
+uint8_t rf24_close_pipe(rf24_pipe_t pipe) {
+    if (pipe > RF24_PIPE5) {
+        return 1;
+    }
+    rf24_write_reg(EN_RXADDR, RF24_SHADOW(EN_RXADDR) & ~(1 << pipe));
+
+    return 0;
+}
+
+/* Auto retransmit delay (us), long enough for the ACK (and its payload) at the data rate */
+static uint16_t rf24_retrans_delay(void) {
+    uint8_t length = RF24_CFG(ack_payload_length);
+
+    if (RF24_CFG(rate) == RF24_RATE_250KBPS) {
+        if (!RF24_CFG(ack_payload)) {
+            return 700; /* Empty ACK */
+        } else if (length < 8) {
+            return 800;
+        } else if (length < 16) {
+            return 1100;
+        } else if (length < 24) {
+            return 1300;
+        }
+        return 1600;
+    }
+    /* 1Mbps or 2Mbps */
+    return RF24_CFG(ack_payload) ? 700 : 300;
+}
+
+#if CONFIG_RF24_RUNTIME_CONFIG
+/**
+ * \brief	Returns the configuration in use: the CONFIG_RF24_* macros of rf24_config.h, or the last one applied
+ * \param 	config - returns the configuration
+ */
+void rf24_get_config(rf24_config_t *config) {
+    *config = rf24_cfg;
+}
+
+/**
+ * \brief	Applies a configuration (usually one returned by rf24_get_config() with some settings changed)
+ * \details	Before rf24_init(), the configuration is used by rf24_init(). After it, the module is configured
+ * 			again as by rf24_recover(), with the address given to rf24_init(): the address width can only be
+ * 			changed before rf24_init().
+ * 			Available with CONFIG_RF24_RUNTIME_CONFIG defined to 1.
+ * \param 	config - configuration to apply
+ * \return	0 - Success
+ * 			1 - Error with SPI communication
+ * 			2 - Invalid configuration, or address width changed after rf24_init() (not applied)
+ */
+uint8_t rf24_apply_config(const rf24_config_t *config) {
+    if ((config->channel > 125) || (config->rate > RF24_RATE_2MBPS) || (config->power > RF24_PWR_0DBM)
+            || (config->addr_len < 3) || (config->addr_len > 5) || (config->retransmits > 15)
+            || (config->payload_length > 32) || (config->ack_payload_length > 32)
+            || (config->ack_payload && !config->dynamic_payload)) {
+        return 2;
+    }
+    if (rf24_initialized && (config->addr_len != rf24_cfg.addr_len)) {
+        return 2;
+    }
+    rf24_cfg = *config;
+    if (!rf24_initialized) {
+        return 0;
+    }
+
+    return rf24_recover();
+}
+#endif
+
 /**
  * \brief	This function initializes the RF module
  * \details Assigns \a address to Pipe 0 and Tx address \n
@@ -302,17 +546,35 @@ void rf24_set_address(rf24_pipe_t pipe, const uint8_t *addr) {
  * 			* 1 - Error with SPI communication
  */
 uint8_t rf24_init(rf24_opmode_t mode, const uint8_t *address) {
-    uint8_t reg_val, ret = 0;
-#if RFM7x_INIT
-    uint8_t i, j, WriteArr[12];
-#endif
+    uint8_t i;
 
 #ifdef LED_DEBUG
 	DBG_LED_OUT();
 #endif
 
+    /* Kept for rf24_recover() */
+    rf24_mode = mode;
+    for (i = 0; i < RF24_CFG(addr_len); i++) {
+        rf24_address[i] = address[i];
+    }
+
     /* low level initialization */
     mcu_init();
+#if CONFIG_RF24_RUNTIME_CONFIG
+    rf24_initialized = true;
+#endif
+
+    return rf24_configure();
+}
+
+/* Configures the RF module for rf24_mode and rf24_address (see rf24_init) */
+static uint8_t rf24_configure(void) {
+    const rf24_opmode_t mode = rf24_mode;
+    const uint8_t *address = rf24_address;
+    uint8_t reg_val, pipe, ret = 0;
+#if RFM7x_INIT
+    uint8_t i, j, WriteArr[12];
+#endif
 
 #if RFM7x_INIT
     _delay_ms(20); //delay more than 50ms?
@@ -321,7 +583,7 @@ uint8_t rf24_init(rf24_opmode_t mode, const uint8_t *address) {
 #endif
 
     /* Set Address */
-    rf24_write_reg(SETUP_AW, (uint8_t) (CONFIG_RF24_ADDR_LEN - 2)); /* Address width */
+    rf24_write_reg(SETUP_AW, (uint8_t) (RF24_CFG(addr_len) - 2)); /* Address width */
     rf24_set_address(RF24_TX_ADDR, address); /* Set same address for Tx and Rx-Pipe0, for Auto-ACK */
     rf24_set_address(RF24_PIPE0, address);
     /* Set other pipe addresses */
@@ -330,56 +592,59 @@ uint8_t rf24_init(rf24_opmode_t mode, const uint8_t *address) {
     reg_val = (1 << 0) | (1 << 1); /* open Pipe0, Pipe1 */
     rf24_write_reg(EN_RXADDR, reg_val);
     reg_val = 0;
-    if (CONFIG_RF24_AUTOACK_ENABLED) {
+    if (RF24_CFG(autoack)) {
         reg_val = (1 << 0) | (1 << 1); /* Enable auto ack (only for Pipe 0, Pipe 1) */
     }
     rf24_write_reg(EN_AA, reg_val);
-    /* Set payload length (only for Pipe 0)*/
-	rf24_write_reg(RX_PW_P0, CONFIG_RF24_STATIC_PL_LENGTH);
-	rf24_write_reg(RX_PW_P1, CONFIG_RF24_STATIC_PL_LENGTH);
+    /* Set payload length (only for Pipe 0, Pipe 1; 0 for the closed pipes) */
+    for (pipe = 0; pipe < 6; pipe++) {
+        rf24_write_reg(RX_PW_P0 + pipe, (pipe < 2) ? RF24_CFG(payload_length) : 0);
+    }
 
     /* FEATURE reg */
 	reg_val = (1 << 0); /* EN_DYN_ACK bit */
-	if(CONFIG_RF24_DYNAMIC_PL_ENABLED) {
+	if(RF24_CFG(dynamic_payload)) {
 		reg_val |= (1 << 2)|(1 << 1); /* EN_DPL and EN_ACK_PAY bits */
 	}
-	if (0 == rf24_read_reg(FEATURE)) {
-		rf24_write_reg(ACTIVATE, 0x73); /* Unlock FEATURE register */
+	/* Unlock FEATURE register (nRF24L01, RFM7x). ACTIVATE toggles the lock, so the register is read once when
+	 * the shadow does not tell: first configuration since reset of the MCU, or recovery of the module */
+	if ((0 == RF24_SHADOW(FEATURE)) && (0 == rf24_read_reg(FEATURE))) {
+		rf24_write_reg(ACTIVATE, 0x73);
 	}
 	rf24_write_reg(FEATURE, reg_val);
 
     /* DYNPD register */
-    if (CONFIG_RF24_DYNAMIC_PL_ENABLED) { /* Enable dynamic payload length (for Pipe 0, Pipe 1 only) */
+    reg_val = 0;
+    if (RF24_CFG(dynamic_payload)) { /* Enable dynamic payload length (for Pipe 0, Pipe 1 only) */
         reg_val = (1 << 0) | (1 << 1);
-        rf24_write_reg(DYNPD, reg_val);
     }
+    rf24_write_reg(DYNPD, reg_val); /* Written in any case, for the shadow copy */
 
     /* Retransmit reg */
     reg_val = 0;
-    if (CONFIG_RF24_AUTOACK_ENABLED) {
-        reg_val = (((CONFIG_RF24_RETRANS_DELAY / 250) - 1) << 4)
-                | (CONFIG_RF24_TX_RETRANSMITS & 0xF);
+    if (RF24_CFG(autoack)) {
+        reg_val = (((rf24_retrans_delay() / 250) - 1) << 4)
+                | (RF24_CFG(retransmits) & 0xF);
     }
     rf24_write_reg(SETUP_RETR, reg_val);
 
-    /* RF setup reg */
-    reg_val = rf24_read_reg(RF_SETUP);
-    reg_val &= ~(RF_DR_LOW | RF_DR_HIGH | RF_PWR1 | RF_PWR0);
-    if (CONFIG_RF24_DATA_RATE == RF24_RATE_250KBPS) {
+    /* RF setup reg: LNA gain bit of the reset value (don't care for nRF24L01+), test bits cleared */
+    reg_val = RF_LNA;
+    if (RF24_CFG(rate) == RF24_RATE_250KBPS) {
         reg_val |= RF_DR_LOW;
-    } else if (CONFIG_RF24_DATA_RATE == RF24_RATE_2MBPS) {
+    } else if (RF24_CFG(rate) == RF24_RATE_2MBPS) {
         reg_val |= RF_DR_HIGH;
     }
-    reg_val |= (CONFIG_RF24_TX_PWR << 1);
+    reg_val |= (RF24_CFG(power) << 1);
     rf24_write_reg(RF_SETUP, reg_val);
 
     /* RF Channel reg*/
-    rf24_write_reg(RF_CH, CONFIG_RF24_RF_CHANNEL);
+    rf24_write_reg(RF_CH, RF24_CFG(channel));
     reg_val = rf24_read_reg(RF_CH);
 #ifdef LED_DEBUG
     LED_Debug(reg_val);
 #endif
-    if (CONFIG_RF24_RF_CHANNEL != reg_val) {
+    if (RF24_CFG(channel) != reg_val) {
         ret = 1;
     }
 
@@ -437,15 +702,11 @@ uint8_t rf24_init(rf24_opmode_t mode, const uint8_t *address) {
  * \brief Switch to Rx mode
  */
 void rf24_rx_mode(void) {
-    uint8_t value;
-
     rf24_write_reg(FLUSH_RX, 0); /* flush Rx FIFO */
-    value = rf24_read_reg(STATUS);
-    rf24_write_reg(STATUS, value); /* clear interrupt flags of STATUS register */
+    rf24_write_reg(STATUS, STAT_TX_DS | STAT_MAX_RT | STAT_RX_DR); /* clear interrupt flags of STATUS register */
     CE_LOW();
-    value = rf24_read_reg(CONFIG); /* Read CONFIG register and  */
-    value |= CONFIG_PRIM_RX; /* set PRIM_RX to enable Rx mode */
-    rf24_write_reg(CONFIG, value);
+    rf24_write_reg(CONFIG, RF24_SHADOW(CONFIG) | CONFIG_PRIM_RX); /* set PRIM_RX to enable Rx mode */
+    rf24_mode = RF24_MODE_PRX;
     CE_HIGH(); /* Set CE high to enter Rx mode */
 }
 
@@ -453,13 +714,10 @@ void rf24_rx_mode(void) {
  * \brief	Switch to Tx mode
  */
 void rf24_tx_mode(void) {
-    uint8_t value;
-
     rf24_write_reg(FLUSH_TX, 0); /* Flush Tx FIFO */
     CE_LOW(); /* Set CE low to exit Rx mode */
-    value = rf24_read_reg(CONFIG); /* Read CONFIG register and  */
-    value &= ~CONFIG_PRIM_RX; /* clear PRIM_RX to enable Tx mode */
-    rf24_write_reg(CONFIG, value);
+    rf24_write_reg(CONFIG, RF24_SHADOW(CONFIG) & ~CONFIG_PRIM_RX); /* clear PRIM_RX to enable Tx mode */
+    rf24_mode = RF24_MODE_PTX;
 }
 
 /**
@@ -467,9 +725,8 @@ void rf24_tx_mode(void) {
  */
 void rf24_powerdown(void) {
 
-    uint8_t value = rf24_read_reg(CONFIG);
-    value &= ~CONFIG_PWR_UP; /* Clear PWR_UP bit in CONFIG register to enter Power down mode */
-    rf24_write_reg(CONFIG, value);
+    /* Clear PWR_UP bit in CONFIG register to enter Power down mode */
+    rf24_write_reg(CONFIG, RF24_SHADOW(CONFIG) & ~CONFIG_PWR_UP);
 }
 
 
@@ -479,14 +736,67 @@ void rf24_powerdown(void) {
  */
 void rf24_powerup(void) {
 
-    uint8_t value = rf24_read_reg(CONFIG);
-    value |= CONFIG_PWR_UP; /* Set PWR_UP bit in CONFIG register to exit Power down mode */
-    rf24_write_reg(CONFIG, value);
+    /* Set PWR_UP bit in CONFIG register to exit Power down mode */
+    rf24_write_reg(CONFIG, RF24_SHADOW(CONFIG) | CONFIG_PWR_UP);
 	_delay_ms(5);	// 1.5ms settling time from Power down mode
 }
 
 
 
+/**
+ * \brief	Recovers the RF module after a transmit timeout
+ * \details	Sets CE LOW, flushes the Tx FIFO, clears the interrupt flags and configures the module again as done by
+ * 			rf24_init(), in the last mode set (rf24_init, rf24_rx_mode or rf24_tx_mode). Pipe addresses set by
+ * 			rf24_set_address() and pipes opened or closed by rf24_open_pipe()/rf24_close_pipe() after rf24_init()
+ * 			should be set again. Packets in flight are counted as failed.
+ * \return	Status of configuration, as rf24_init()
+ */
+uint8_t rf24_recover(void) {
+    uint8_t sreg;
+
+    CE_LOW();
+    rf24_write_reg(FLUSH_TX, 0);
+    rf24_write_reg(STATUS, STAT_TX_DS | STAT_MAX_RT | STAT_RX_DR);
+    sreg = SREG;
+    cli();
+    tx_failed += tx_in_flight;
+    tx_in_flight = 0;
+    tx_done = false;
+    max_retries = false;
+    SREG = sreg;
+    RF24_SHADOW(FEATURE) = 0; /* The module may have been reset: FEATURE read again */
+
+    return rf24_configure();
+}
+
+/* Waits for the end of transmission: 0 - sent, 1 - max retries, 3 - timeout (module recovered) */
+static uint8_t rf24_wait_tx(void) {
+#if CONFIG_RF24_TX_TIMEOUT_MS
+    RF24_DEADLINE_INIT();
+#endif
+
+    do {
+#if CONFIG_RF24_POLLED_MODE
+        rf24_irq();
+#endif
+        if (tx_done == true) {
+            tx_done = false;
+            return 0;
+        }
+        if (max_retries == true) {
+            max_retries = false;
+            return 1;
+        }
+#if CONFIG_RF24_TX_TIMEOUT_MS
+    } while (!RF24_DEADLINE_PASSED());
+
+    rf24_recover();
+    return 3;
+#else
+    } while (1);
+#endif
+}
+
 /**
  * \brief 	This function transmits an RF packet in the specified buffer of the given length
  * \param 	packet - buffer containing packet data
@@ -494,35 +804,19 @@ void rf24_powerup(void) {
  * \return 	Status after transmit operation
  * 			0 - Successfully transmitted
  * 			1 - Not successful (ACK not received)
- * 			2 - Tx FIFO full
+ * 			2 - Tx FIFO full, or packets queued by rf24_queue_packet() still in flight
+ * 			3 - No end of transmission within CONFIG_RF24_TX_TIMEOUT_MS: the module was recovered (see rf24_recover())
  */
 uint8_t rf24_transmit_packet(const uint8_t *packet, uint8_t length) {
-    uint8_t ret;
-
-    if (rf24_read_reg(FIFO_STATUS) & TX_FIFO_FULL) {
+    if (tx_in_flight || (rf24_nop() & STAT_TX_FULL)) {
         return 2;
     }
     //rf24_write_multibyte_reg(RF24_TX_PLOAD, packet, length);
     rf24_write_buf(WR_TX_PLOAD, packet, length);
     CE_PULSE()
     ;
-    do {
-#if CONFIG_RF24_POLLED_MODE
-        rf24_irq();
-#endif
-        if (tx_done == true) {
-            tx_done = false;
-            ret = 0;
-            break;
-        }
-        if (max_retries == true) {
-            max_retries = false;
-            ret = 1;
-            break;
-        }
-    } while (1);
 
-    return ret;
+    return rf24_wait_tx();
 }
 
 /**
@@ -533,39 +827,260 @@ uint8_t rf24_transmit_packet(const uint8_t *packet, uint8_t length) {
  * \return 	Status after transmit operation
  * 			0 - Successfully transmitted
  * 			1 - Not successful (ACK not received)
- * 			2 - Tx FIFO full
+ * 			2 - Tx FIFO full, or packets queued by rf24_queue_packet() still in flight
+ * 			3 - No end of transmission within CONFIG_RF24_TX_TIMEOUT_MS: the module was recovered (see rf24_recover())
  */
 uint8_t rf24_transmit_packet_noack(const uint8_t *packet, uint8_t length) {
-    uint8_t ret;
-
-    if (rf24_read_reg(FIFO_STATUS) & TX_FIFO_FULL) {
+    if (tx_in_flight || (rf24_nop() & STAT_TX_FULL)) {
         return 2;
     }
     //rf24_write_multibyte_reg(RF24_TX_PLOAD, packet, length);
     rf24_write_buf(WR_NAC_TX_PLOAD, packet, length);
     CE_PULSE()
     ;
-    do {
-#if CONFIG_RF24_POLLED_MODE
-        rf24_irq();
-#endif
-        if (tx_done == true) {
-            tx_done = false;
-            ret = 0;
-            break;
+
+    return rf24_wait_tx();
+}
+
+/* Air time of a packet (us): preamble, address, 9-bit packet control field, payload and 2-byte CRC */
+static uint16_t rf24_air_time_us(uint8_t length) {
+    uint16_t bits = 8 * (1 + RF24_CFG(addr_len) + length + 2) + 9;
+
+    /* Not #if: the data rate is an enum constant */
+    if (RF24_CFG(rate) == RF24_RATE_250KBPS) {
+        return bits * 4;
+    } else if (RF24_CFG(rate) == RF24_RATE_2MBPS) {
+        return (bits + 1) / 2;
+    }
+    return bits;
+}
+
+/* Writes a payload counted in flight. Counted before the payload is written, so that its TX_DS is never
+ * taken for a blocking transmit. The bus is held from the count to the end of the write: the IRQ handler
+ * is deferred meanwhile, so it never finds TX_EMPTY with a payload counted but not yet in the FIFO */
+static void rf24_queue(const uint8_t *packet, uint8_t length, rf24_payload_t type) {
+    CSN_LOW();
+    tx_in_flight++;
+    SPI_TxRx((type == RF24_TX_PLOAD_NOACK) ? WR_NAC_TX_PLOAD : WR_TX_PLOAD);
+    SPI_TxBuf(packet, length);
+    CSN_HIGH();
+}
+
+/* Handles the completed packets, returns FIFO_STATUS */
+static uint8_t rf24_tx_update(void) {
+    uint8_t sreg, fifo, status;
+
+    /* No IRQ handling between reading FIFO_STATUS and handling the STATUS clocked out with it */
+    sreg = SREG;
+    cli();
+    fifo = rf24_read_reg_status(FIFO_STATUS, &status);
+    rf24_handle_status(status);
+    if ((fifo & TX_EMPTY) && tx_in_flight) {
+        tx_sent += tx_in_flight;
+        tx_in_flight = 0;
+        CE_LOW();
+    }
+    SREG = sreg;
+
+    return fifo;
+}
+
+/**
+ * \brief 	Queues a packet for transmission without waiting for the end of transmission
+ * \details	Up to 3 packets are kept in the Tx FIFO of the radio, with CE held HIGH: the next packet is sent as
+ * 			soon as the previous one completes, while the MCU prepares the following one. Completions are counted
+ * 			from the IRQ (interrupt mode) or by rf24_tx_poll(), and CE is set LOW once the FIFO is empty.
+ * 			rf24_transmit_packet() and rf24_transmit_packet_noack() should not be used while packets are in flight.
+ * 			Packets without ACK are not queued: the radio would stay in TX mode with no limit while CE is
+ * 			HIGH. Send them with rf24_stream_write(), which keeps within the TX mode limit.
+ * \param 	packet - buffer containing packet data
+ * \param 	length - size of the packet
+ * \param 	type - RF24_TX_PLOAD
+ * \return 	0 - Packet queued
+ * 			1 - Invalid type (RF24_TX_PLOAD_NOACK)
+ * 			2 - Tx FIFO full (3 packets in flight), call rf24_tx_poll() and retry
+ */
+uint8_t rf24_queue_packet(const uint8_t *packet, uint8_t length, rf24_payload_t type) {
+    if (type != RF24_TX_PLOAD) {
+        return 1;
+    }
+    if ((tx_in_flight >= 3) && (rf24_tx_poll(0) >= 3)) {
+        return 2;
+    }
+    rf24_queue(packet, length, type);
+    CE_HIGH();
+
+    return 0;
+}
+
+/**
+ * \brief 	Updates the counters of queued packets
+ * \details	TX_DS flags of packets completed back to back are merged into one, so packets still counted in
+ * 			flight once the Tx FIFO is empty are counted as sent. In interrupt mode the IRQ handler reads
+ * 			FIFO_STATUS for this when packets remain in flight after a TX_DS, and sets CE LOW without waiting
+ * 			for this function. After MAX_RT the Tx FIFO is flushed and all packets in flight are counted as failed.
+ * 			In polled mode, this function should be called regularly while packets are in flight.
+ * \param 	counters - returns the counters (NULL if not needed)
+ * \return 	Number of packets in flight
+ */
+uint8_t rf24_tx_poll(rf24_tx_counters_t *counters) {
+    uint8_t sreg;
+
+    rf24_tx_update();
+    sreg = SREG;
+    cli();
+    if (counters) {
+        counters->in_flight = tx_in_flight;
+        counters->sent = tx_sent;
+        counters->failed = tx_failed;
+    }
+    SREG = sreg;
+
+    return tx_in_flight;
+}
+
+/**
+ * \brief 	Starts a stream of packets, sent at the maximum sustained rate of the radio
+ * \details	CE is held HIGH and the Tx FIFO is refilled by rf24_stream_write() whenever it has room, so the
+ * 			radio goes from one packet to the next without the CE pulse of rf24_transmit_packet(). For
+ * 			RF24_TX_PLOAD_NOACK streams the radio would stay in TX mode as long as the FIFO is not empty: the
+ * 			air time of the packets written since it entered TX mode is added up and the FIFO is left to drain
+ * 			before it exceeds RF24_TX_MODE_MAX_US (4 ms for nRF24L01+). Acknowledged packets leave TX mode for
+ * 			each ACK, so they are not limited.
+ * 			Completions are counted as for rf24_queue_packet().
+ * \param 	type - RF24_TX_PLOAD, or RF24_TX_PLOAD_NOACK
+ */
+void rf24_stream_begin(rf24_payload_t type) {
+    stream_type = type;
+    stream_air_us = 0;
+    stream_failed = tx_failed;
+}
+
+/**
+ * \brief 	Writes the next packet of the stream, if the Tx FIFO has room
+ * \param 	packet - buffer containing packet data
+ * \param 	length - size of the packet
+ * \return 	0 - Packet written
+ * 			2 - Tx FIFO full, or draining for the TX mode limit: retry later (the packet is not written)
+ */
+uint8_t rf24_stream_write(const uint8_t *packet, uint8_t length) {
+    uint8_t fifo = rf24_tx_update();
+    uint16_t air;
+
+    if (fifo & TX_FIFO_FULL) {
+        return 2;
+    }
+    if (stream_type == RF24_TX_PLOAD_NOACK) {
+        air = rf24_air_time_us(length);
+        if (fifo & TX_EMPTY) {
+            /* Radio left TX mode (Standby-II): next packet starts a new TX period, after settling */
+            CE_LOW();
+            stream_air_us = RF24_TX_SETTLE_US;
+        } else if ((stream_air_us + air) > RF24_TX_MODE_MAX_US) {
+            return 2;
         }
-        if (max_retries == true) {
-            max_retries = false;
-            ret = 1;
-            break;
+        stream_air_us += air;
+    }
+    rf24_queue(packet, length, stream_type);
+    CE_HIGH();
+
+    return 0;
+}
+
+/**
+ * \brief 	Waits for the end of the stream and sets CE LOW
+ * \param 	counters - returns the counters (NULL if not needed)
+ * \return 	0 - All packets of the stream sent
+ * 			1 - Some packets failed (see counters)
+ * 			3 - Packets still in flight after CONFIG_RF24_TX_TIMEOUT_MS: the module was recovered (see rf24_recover())
+ */
+uint8_t rf24_stream_end(rf24_tx_counters_t *counters) {
+#if CONFIG_RF24_TX_TIMEOUT_MS
+    RF24_DEADLINE_INIT();
+
+    while (rf24_tx_poll(counters)) {
+        if (RF24_DEADLINE_PASSED()) {
+            rf24_recover();
+            rf24_tx_poll(counters);
+            return 3;
         }
-    } while (1);
+    }
+#else
+    while (rf24_tx_poll(counters))
+        ;
+#endif
+    CE_LOW();
 
-    return ret;
+    return (tx_failed != stream_failed) ? 1 : 0;
+}
+
+/* STATUS value for rf24_read_rx_fifo() when none was read since the last packet was taken. With dynamic payload
+ * length, the one clocked out with R_RX_PL_WID is used: bit 7 (reserved, reads 0) marks the value as not read */
+#define RF24_STATUS_UNREAD	(1 << 7)
+#define RF24_RX_STATUS()	(RF24_CFG(dynamic_payload) ? RF24_STATUS_UNREAD : rf24_nop())
+
+/* Reads the packet at the head of the Rx FIFO into buf, status being a STATUS value read since the last packet
+ * was taken (its RX_P_NO gives the pipe) or RF24_RX_STATUS(). Returns the pipe (*size = 0 if invalid and
+ * flushed), or 7 if the FIFO is empty */
+static uint8_t rf24_read_rx_fifo(uint8_t status, uint8_t *buf, uint8_t *size) {
+    uint8_t pipe = (status & STAT_RX_P_NO) >> 1;
+
+    *size = 0;
+    if (RF24_CFG(dynamic_payload)) {
+        if (status & RF24_STATUS_UNREAD) {
+            *size = rf24_read_reg_status(RD_RX_PLOAD_W, &status);
+            pipe = (status & STAT_RX_P_NO) >> 1;
+        } else if ((pipe < 6) && (RF24_SHADOW(DYNPD) & (1 << pipe))) {
+            *size = rf24_read_reg(RD_RX_PLOAD_W);
+        }
+    }
+    if (pipe > 5) {
+        *size = 0;
+        return 7;
+    }
+    if (!(RF24_SHADOW(DYNPD) & (1 << pipe))) {
+        *size = RF24_SHADOW(RX_PW_P0 + pipe); /* Static payload length of the pipe */
+    } else if (*size > 32) { // Invalid packet size : discard packet
+        *size = 0;
+        rf24_write_reg(FLUSH_RX, 0);
+        return pipe;
+    }
+    CSN_LOW();
+    SPI_TxRx(RD_RX_PLOAD);
+    SPI_RxBuf(buf, *size);
+    CSN_HIGH();
+
+    return pipe;
+}
+
+#if CONFIG_RF24_RX_QUEUE_DEPTH
+/* Moves packets from the Rx FIFO to the queue, until the FIFO is empty or the queue is full. status: see
+ * rf24_read_rx_fifo() */
+static void rf24_rx_drain(uint8_t status) {
+    rf24_rx_entry_t *entry;
+    uint8_t pipe;
+
+    rx_ready = false;
+    while (rx_count < CONFIG_RF24_RX_QUEUE_DEPTH) {
+        entry = &rx_queue[(rx_head + rx_count) % CONFIG_RF24_RX_QUEUE_DEPTH];
+        pipe = rf24_read_rx_fifo(status, entry->payload, &entry->len);
+        if (pipe > 5) {
+            return;
+        }
+        if (entry->len) {
+            entry->pipe = pipe;
+            rx_count++;
+        }
+        status = RF24_RX_STATUS(); /* Pipe of the next packet */
+    }
+    rx_ready = true; /* Queue full: rest is read when a packet is taken */
 }
+#endif
 
 /**
  * \brief	This function stores a received packet, if available, into the specified buffer
+ * \details	One packet is returned per call: call again while \a size is non-zero to get all the packets received.
+ * 			With CONFIG_RF24_RX_QUEUE_DEPTH, packets are taken from the queue filled from the IRQ.
  * \note	After calling the function, verify non-zero value of \a size to know whether a packet is received.
  * \param	buf		Buffer to store the received packet
  * \param 	size	Location to return the size of the received packet. Zero is returned if packet is invalid or not available.
@@ -573,30 +1088,62 @@ uint8_t rf24_transmit_packet_noack(const uint8_t *packet, uint8_t length) {
  */
 uint8_t rf24_receive_packet(uint8_t *buf, uint8_t *size) {
     uint8_t rx_pipe = 0;
+#if CONFIG_RF24_RX_QUEUE_DEPTH
+    rf24_rx_entry_t *entry;
+    uint8_t i, sreg;
+#else
+    uint8_t status;
+#endif
 
 #if CONFIG_RF24_POLLED_MODE
+#if CONFIG_RF24_RX_QUEUE_DEPTH
     rf24_irq();
+#else
+    status = rf24_irq();
+#endif
 #endif
 	*size = 0;
+#if CONFIG_RF24_RX_QUEUE_DEPTH
+    if (rx_count) {
+        entry = &rx_queue[rx_head];
+        for (i = 0; i < entry->len; i++) {
+            buf[i] = entry->payload[i];
+        }
+        *size = entry->len;
+        rx_pipe = entry->pipe;
+        sreg = SREG;
+        cli();
+        rx_head = (rx_head + 1) % CONFIG_RF24_RX_QUEUE_DEPTH;
+        rx_count--;
+        SREG = sreg;
+    }
     if (rx_ready == true) {
-        rx_ready = false;
-        rx_pipe = rf24_get_rx_pipe();
-        do {
-#if CONFIG_RF24_DYNAMIC_PL_ENABLED
-            if ((*size = rf24_read_reg(RD_RX_PLOAD_W)) > 32) { // Invalid packet size : discard packet
-                *size = 0;
-                rf24_write_reg(FLUSH_RX, 0);
-                break;
-            }
+        /* Queue was full: packets left in the Rx FIFO */
+#if !CONFIG_RF24_POLLED_MODE
+        irq_hold = true;	/* Not unmasked by a deferred IRQ while draining */
+        RF24_INT_DISABLE();
+        rf24_rx_drain(RF24_RX_STATUS());
+        irq_hold = false;
+        RF24_INT_ENABLE();
+#else
+        rf24_rx_drain(RF24_RX_STATUS());
+#endif
+    }
 #else
-            *size = rf24_read_reg(RX_PW_P0);
+    if (rx_ready == true) {
+        /* One packet per call. Cleared first, so that a packet received meanwhile is not missed */
+        rx_ready = false;
+#if !CONFIG_RF24_POLLED_MODE
+        status = RF24_RX_STATUS();
 #endif
-            CSN_LOW();
-            SPI_TxRx(RD_RX_PLOAD);
-            SPI_RxBuf(buf, *size);
-            CSN_HIGH();
-        } while (!(rf24_read_reg(FIFO_STATUS) & RX_EMPTY));
+        rx_pipe = rf24_read_rx_fifo(status, buf, size);
+        if (rx_pipe < 6) {
+            rx_ready = true; /* More packets may be in the FIFO */
+        } else {
+            rx_pipe = 0;
+        }
     }
+#endif
 
     return rx_pipe;
 }
@@ -634,37 +1181,72 @@ uint8_t rf24_get_observe_tx(void) {
     uint8_t reg_val;
     reg_val = rf24_read_reg(OBSERVE_TX);
     if (reg_val > 0xEF) { /* PLOS_CNT reached maximum value of 0xF */
-        rf24_write_reg(RF_CH, rf24_read_reg(RF_CH)); /* reset OBSERVE_TX by writing into RF_CH */
+        rf24_write_reg(RF_CH, RF24_SHADOW(RF_CH)); /* reset OBSERVE_TX by writing into RF_CH */
     }
     return reg_val;
 }
 
 /**
  * \brief	Function to handle Interrupt of RF module. Also used to poll the status continuously in polled mode
+ * \return	STATUS register
  */
-static void rf24_irq(void) {
-    uint8_t status;
+static uint8_t rf24_irq(void) {
+    return rf24_handle_status(rf24_nop());
+}
+
+/* Handles the interrupt flags of a STATUS value clocked out by a command. Returns status */
+static uint8_t rf24_handle_status(uint8_t status) {
+    uint8_t flags = status & (STAT_RX_DR | STAT_TX_DS | STAT_MAX_RT);
 
-    //status = rf24_write_reg(STATUS, (STAT_MAX_RT|STAT_TX_DS|STAT_RX_DR)); /* Get and clear interrupt flags */
-    status = rf24_read_reg(STATUS);
-    if (status) {
-        rf24_write_reg(STATUS, status);
+    if (flags) {
+        if ((status & STAT_MAX_RT) && tx_in_flight) {
+            /* With CE HIGH, clearing MAX_RT would send the failed packet again, before the flush below */
+            CE_LOW();
+        }
+        /* Only the flags seen are cleared: writing all of them would lose a flag set during the write */
+        rf24_write_reg(STATUS, flags);
         if (status & STAT_RX_DR) {
             /* received data */
             rx_ready = true;
+#if CONFIG_RF24_RX_QUEUE_DEPTH
+            rf24_rx_drain(status);
+#endif
         }
 
         if (status & STAT_TX_DS) {
             /* transmit done */
-            tx_done = true;
+            if (tx_in_flight) {
+                tx_sent++;
+                tx_in_flight--;
+#if !CONFIG_RF24_POLLED_MODE
+                if (tx_in_flight && (rf24_read_reg(FIFO_STATUS) & TX_EMPTY)) {
+                    /* TX_DS of the next packets merged with this one (done by rf24_tx_update() when polled) */
+                    tx_sent += tx_in_flight;
+                    tx_in_flight = 0;
+                }
+#endif
+                if (!tx_in_flight) {
+                    CE_LOW(); /* Queue sent: back to Standby-I */
+                }
+            } else {
+                tx_done = true;
+            }
         }
 
         if (status & STAT_MAX_RT) {
             /* Maximum retries exceeded */
-            max_retries = true;
             rf24_write_reg(FLUSH_TX, 0); //flush Tx fifo
+            if (tx_in_flight) {
+                /* Failed packet and the ones queued after it */
+                tx_failed += tx_in_flight;
+                tx_in_flight = 0;
+            } else {
+                max_retries = true;
+            }
         }
     }
+
+    return status;
 }
 
 /**
@@ -672,8 +1254,25 @@ static void rf24_irq(void) {
  * \details	Reads status register and sets appropriate flags
  */
 #if !CONFIG_RF24_POLLED_MODE
+/* Run when the SPI bus is released by the interrupted code, from its context: only unmasks the IRQ, which
+ * is still low, so that this handler runs again as soon as interrupts are enabled */
+static void rf24_irq_unmask(void) {
+    if (!irq_hold) {
+        RF24_INT_ENABLE();
+    }
+}
+
+static spi_deferred_t rf24_irq_wait = { .func = rf24_irq_unmask };
+
 ISR(INT1_vect) {
     //PORTB &= ~(1 << 0); // LED OFF
+    if (SPI_Bus_Busy()) {
+        /* An SPI transaction (to this or another device) is in progress: IRQ is low-level triggered,
+         * so it is masked until the transaction ends */
+        RF24_INT_DISABLE();
+        SPI_Defer(&rf24_irq_wait);
+        return;
+    }
     rf24_irq();
 }
 #endif
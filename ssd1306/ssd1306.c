@@ -15,7 +15,7 @@
 
 /**************************** VARIABLES ********************************/
 
-static uint8_t _page_buf[129] = {OLED_CONTROL_BYTE_DATA_STREAM};  /* Buffer to be used for stream data communication */
+static uint8_t _page_buf[OLED_DISPLAY_WIDTH];  /* Buffer to be used for stream data communication (control byte is sent as prefix) */
 static const uint8_t * current_font;	/* Points to the current font data in flash */
 static uint8_t  current_font_height;		/* Font height as number of pages(rows) */
 static uint8_t 	font_page;				/* Next page to be written */
@@ -86,8 +86,22 @@ static uint8_t oled_page_mode_cmd[6] = {
 
 /******************************* PRIVATE FUNCTIONS ***********************************/
 
-static uint8_t oled_send_buf(uint8_t *buf, uint8_t len)
+static uint8_t oled_send_buf(const uint8_t *buf, uint8_t len)
 {
+	twi_params.tx_prefix_count = 0;
+	twi_params.tx_buf = buf;
+	twi_params.tx_count = len;
+	if(TWI_Master_Transfer(&twi_params) != TWI_STATUS_DONE) {
+		return 1;
+	}
+	return 0;
+}
+
+/* Sends the control byte as prefix, followed by buf, without copying them together */
+static uint8_t oled_send_prefixed(uint8_t control, const uint8_t *buf, uint8_t len)
+{
+	twi_params.tx_prefix[0] = control;
+	twi_params.tx_prefix_count = 1;
 	twi_params.tx_buf = buf;
 	twi_params.tx_count = len;
 	if(TWI_Master_Transfer(&twi_params) != TWI_STATUS_DONE) {
@@ -98,20 +112,12 @@ static uint8_t oled_send_buf(uint8_t *buf, uint8_t len)
 
 uint8_t oled_command(uint8_t cmd)
 {
-	uint8_t tx_data[2];
-	
-	tx_data[0] = OLED_CONTROL_BYTE_CMD;
-	tx_data[1] = cmd;
-	return oled_send_buf(tx_data, sizeof(tx_data));
+	return oled_send_prefixed(OLED_CONTROL_BYTE_CMD, &cmd, 1);
 }
 
 uint8_t oled_data(uint8_t data)
 {
-	uint8_t tx_data[2];
-	
-	tx_data[0] = OLED_CONTROL_BYTE_DATA;
-	tx_data[1] = data;
-	return oled_send_buf(tx_data, sizeof(tx_data));
+	return oled_send_prefixed(OLED_CONTROL_BYTE_DATA, &data, 1);
 }
 
 /* Initialize OLED display */
@@ -119,6 +125,9 @@ uint8_t oled_init(void)
 {
 	/* Initialize AVR TWI bus */
 	TWI_Init();
+	if(!TWI_Device_Present(OLED_I2C_SLA_ADDR)) {
+		return TWI_STATUS_NOACK;
+	}
 	/* Initialize SSD1306 display */
 	return oled_send_buf(oled_init_cmds, sizeof(oled_init_cmds));	
 }
@@ -162,6 +171,12 @@ uint8_t oled_display_data(uint8_t *buf, uint8_t size)
 }
 
 
+uint8_t oled_stream_data(const uint8_t *data, uint8_t count)
+{
+	return oled_send_prefixed(OLED_CONTROL_BYTE_DATA_STREAM, data, count);
+}
+
+
 void oled_clear_area(uint8_t page_range, uint8_t col_start, uint8_t col_end)
 {
 	uint8_t i;
@@ -169,12 +184,12 @@ void oled_clear_area(uint8_t page_range, uint8_t col_start, uint8_t col_end)
 	if(col_start > col_end) {
 		return;
 	}
-	for( i = 1; i < sizeof(_page_buf); i++) {
+	for( i = 0; i < sizeof(_page_buf); i++) {
 		_page_buf[i] = 0;
 	}
 	for(i = page_range & 0xF; i <= (page_range >> 4); i++) {
 		oled_page_mode(i, col_start);
-		oled_display_data(_page_buf, (col_end - col_start + 2));
+		oled_stream_data(_page_buf, (col_end - col_start + 1));
 	}
 
 }
@@ -268,14 +283,14 @@ uint8_t oled_putchar(char c)
 	}
 	fontPtr += (charCount+index);
 	oled_horizontal_mode(OLED_PAGE_RANGE(font_page, font_page+height-1), font_column, font_column+width);
-	cnt = 1;
+	cnt = 0;
 	while(height--) {
 		for(uint8_t i = 0; i < width; i++) {
 			_page_buf[cnt++] = pgm_read_byte(fontPtr++);
 		}
 		_page_buf[cnt++] = 0;
 	}
-	oled_display_data(_page_buf, cnt);
+	oled_stream_data(_page_buf, cnt);
 	/* Reset Row and Column range to the entire display, after using horizontal mode */
 	oled_reset_range();
 	/* update position */
@@ -417,12 +432,12 @@ void oled_horizontal_line(uint8_t x1, uint8_t x2, uint8_t y)
 	}
 	oled_page_mode(page, x1);
 	y -= (page << 3);	/* page*8 */
-	i = 1;
+	i = 0;
 	do {
 		_page_buf[i++] = (1 << y);
 		x1++;
 	} while(x1 <= x2);
-	oled_display_data(_page_buf, i);
+	oled_stream_data(_page_buf, i);
 
 }
 
@@ -83,6 +83,11 @@ struct oled_disp_struct {
 
 /********************* Function declarations ***********************/
 
+/* Initializes the display
+ * Returns: 0 - success
+ *			TWI_STATUS_NOACK - Display not present on the bus (init sequence not sent)
+ *			1 - Error
+ */
 uint8_t oled_init(void);
 uint8_t oled_data(uint8_t data);
 uint8_t oled_command(uint8_t cmd);
@@ -108,6 +113,18 @@ uint8_t oled_horizontal_mode(uint8_t page_range, uint8_t col_start, uint8_t col_
 uint8_t oled_display_data(uint8_t *buf, uint8_t size);
 
 
+/**
+ * @brief Send display data as a data stream, without a control byte slot in the buffer
+ *        The control byte is sent ahead of the data by the TWI driver, so data can be
+ *        streamed directly from a framebuffer
+ * @param data - Display data
+ * @param count - Number of data bytes
+ * @return 0 - Success
+ *         1 - Error
+ */
+uint8_t oled_stream_data(const uint8_t *data, uint8_t count);
+
+
 /**
  * @brief Clear an area bounded by a page and column range
  * @param page_range - Start and end page defined using OLED_PAGE_RANGE() macro